@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Contiguous view of trivially destructible objects carved from a ScratchArena.
+ * It does not own the memory, which stays valid until the next reset of the arena.
+*/
+template <typename T>
+struct ArenaSpan
+{
+    T * fData = nullptr;
+    size_t fSize = 0;
+
+    inline T * data() const { return fData; }
+    inline size_t size() const { return fSize; }
+    inline T& operator[] (const size_t i) const { return fData[i]; }
+    inline T * begin() const { return fData; }
+    inline T * end() const { return fData + fSize; }
+};
+
+/**
+ * Fixed-capacity vector carved from a ScratchArena (no reallocation, push_back beyond the capacity is ignored)
+*/
+template <typename T>
+struct ArenaVector
+{
+    T * fData = nullptr;
+    size_t fSize = 0, fCapacity = 0;
+
+    inline void push_back(const T& value) { if (fSize < fCapacity) fData[fSize++] = value; }
+    inline void clear() { fSize = 0; }
+    inline T * data() const { return fData; }
+    inline size_t size() const { return fSize; }
+    inline size_t capacity() const { return fCapacity; }
+    inline T& operator[] (const size_t i) const { return fData[i]; }
+    inline T * begin() const { return fData; }
+    inline T * end() const { return fData + fSize; }
+};
+
+/**
+ * Bump allocator for short-lived scratch buffers (partner lists, pair batches, ...).
+ * Allocations are served from a list of blocks and released all at once by reset(). When a work unit needs
+ * more than the first block, reset() coalesces the blocks into a single larger one, so that once the
+ * high-water mark has been reached the arena performs no further heap allocations.
+ * Each allocation is aligned to kAlignment bytes, to allow vectorised loops over the returned buffers.
+ * Not thread-safe: one arena per worker.
+*/
+class ScratchArena
+{
+    public:
+        static constexpr size_t kAlignment = 64;
+
+        ScratchArena(const size_t initialCapacity = 1 << 16) { addBlock(initialCapacity); }
+        ~ScratchArena() { releaseBlocks(); }
+        ScratchArena(const ScratchArena&) = delete;
+        ScratchArena& operator= (const ScratchArena&) = delete;
+        ScratchArena(ScratchArena&& other) noexcept { *this = std::move(other); }
+        ScratchArena& operator= (ScratchArena&& other) noexcept;
+
+        template <typename T>
+        ArenaSpan<T> allocate(const size_t n);
+        template <typename T>
+        ArenaVector<T> allocateVector(const size_t capacity);
+
+        void reset();
+
+        inline size_t getCapacity() const;
+        inline size_t getHighWaterMark() const { return fHighWaterMark; }
+        inline long long getNHeapAllocations() const { return fNHeapAllocations; }
+
+    private:
+        struct Block
+        {
+            std::byte * fData = nullptr;
+            size_t fCapacity = 0;
+        };
+
+        void * allocateBytes(const size_t nBytes);
+        void addBlock(const size_t capacity);
+        void releaseBlocks();
+
+        std::vector<Block> fBlocks;
+        size_t fCurrentBlock = 0;       // block serving the allocations
+        size_t fOffset = 0;             // first free byte in the current block
+        size_t fUsed = 0;               // bytes handed out since the last reset
+        size_t fHighWaterMark = 0;      // maximum of fUsed over the lifetime of the arena
+        long long fNHeapAllocations = 0;
+};
+
+ScratchArena& ScratchArena::operator= (ScratchArena&& other) noexcept
+{
+    if (this == &other)
+        return *this;
+    releaseBlocks();
+    fBlocks = std::move(other.fBlocks);
+    fCurrentBlock = other.fCurrentBlock;
+    fOffset = other.fOffset;
+    fUsed = other.fUsed;
+    fHighWaterMark = other.fHighWaterMark;
+    fNHeapAllocations = other.fNHeapAllocations;
+    other.fBlocks.clear();
+    other.fCurrentBlock = other.fOffset = other.fUsed = 0;
+    return *this;
+}
+
+template <typename T>
+ArenaSpan<T> ScratchArena::allocate(const size_t n)
+{
+    static_assert(std::is_trivially_destructible<T>::value, "ScratchArena only holds trivially destructible types");
+    static_assert(alignof(T) <= kAlignment, "Over-aligned type");
+    return ArenaSpan<T>{static_cast<T *>(allocateBytes(n * sizeof(T))), n};
+}
+
+template <typename T>
+ArenaVector<T> ScratchArena::allocateVector(const size_t capacity)
+{
+    const ArenaSpan<T> span = allocate<T>(capacity);
+    return ArenaVector<T>{span.data(), 0, capacity};
+}
+
+void * ScratchArena::allocateBytes(const size_t nBytes)
+{
+    const size_t alignedBytes = std::max<size_t>(kAlignment, (nBytes + kAlignment - 1) / kAlignment * kAlignment);
+
+    while (fOffset + alignedBytes > fBlocks[fCurrentBlock].fCapacity)
+    {
+        if (fCurrentBlock + 1 == fBlocks.size())
+            addBlock(std::max(alignedBytes, 2 * fBlocks[fCurrentBlock].fCapacity));
+        fCurrentBlock++;
+        fOffset = 0;
+    }
+
+    void * pointer = fBlocks[fCurrentBlock].fData + fOffset;
+    fOffset += alignedBytes;
+    fUsed += alignedBytes;
+    fHighWaterMark = std::max(fHighWaterMark, fUsed);
+    return pointer;
+}
+
+void ScratchArena::reset()
+{
+    if (fBlocks.size() > 1)
+    {
+        const size_t capacity = getCapacity();
+        releaseBlocks();
+        addBlock(capacity);
+    }
+    fCurrentBlock = 0;
+    fOffset = 0;
+    fUsed = 0;
+}
+
+size_t ScratchArena::getCapacity() const
+{
+    size_t capacity = 0;
+    for (const auto& block : fBlocks)
+        capacity += block.fCapacity;
+    return capacity;
+}
+
+void ScratchArena::addBlock(const size_t capacity)
+{
+    const size_t alignedCapacity = (capacity + kAlignment - 1) / kAlignment * kAlignment;
+    Block block;
+    block.fData = static_cast<std::byte *>(::operator new(alignedCapacity, std::align_val_t(kAlignment)));
+    block.fCapacity = alignedCapacity;
+    fBlocks.push_back(block);
+    fNHeapAllocations++;
+}
+
+void ScratchArena::releaseBlocks()
+{
+    for (auto& block : fBlocks)
+        ::operator delete(block.fData, std::align_val_t(kAlignment));
+    fBlocks.clear();
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "boundedQueue.hh"
+
+/**
+ * Collects items in batches and hands them to a writing function.
+ * In synchronous mode each item is written as soon as it is pushed. In asynchronous mode full batches are
+ * written by a dedicated thread: nBuffers batches circulate between the producer and the writer through two
+ * bounded queues (filled and free), so the producer blocks only when all the buffers are waiting to be written.
+ * Batches are written in the order they were filled. The batch size is at least 1 and the asynchronous mode uses at
+ * least 2 buffers (one filled by the producer, one written).
+*/
+template <typename T>
+class AsyncBatchWriter
+{
+    public:
+        using WriteFunction = std::function<void(const std::vector<T>&)>;
+
+        AsyncBatchWriter(WriteFunction writeBatch, const bool async = false, const size_t batchSize = 4096,
+                         const int nBuffers = 4);
+        ~AsyncBatchWriter() { finish(); }
+        AsyncBatchWriter(const AsyncBatchWriter&) = delete;
+        AsyncBatchWriter& operator= (const AsyncBatchWriter&) = delete;
+
+        void push(const T& item);
+        void sync();
+        void finish();
+
+    private:
+        void flush();
+
+        WriteFunction fWriteBatch;
+        bool fAsync = false;
+        bool fFinished = false;
+        size_t fBatchSize = 4096;
+        int fNBuffers = 4;
+        std::vector<T> fCurrentBatch;
+        BoundedQueue<std::vector<T>> fFilledBatches;
+        BoundedQueue<std::vector<T>> fFreeBatches;
+        std::thread fWriterThread;
+};
+
+template <typename T>
+AsyncBatchWriter<T>::AsyncBatchWriter(WriteFunction writeBatch, const bool async, const size_t batchSize, const int nBuffers)
+    : fWriteBatch(writeBatch), fAsync(async), fBatchSize(async ? std::max<size_t>(batchSize, 1) : 1),
+      fNBuffers(std::max(nBuffers, 2)), fFilledBatches(fNBuffers), fFreeBatches(fNBuffers)
+{
+    fCurrentBatch.reserve(fBatchSize);
+    if (!fAsync)
+        return;
+
+    for (int iBuffer = 1; iBuffer < fNBuffers; iBuffer++)
+    {
+        std::vector<T> batch;
+        batch.reserve(fBatchSize);
+        fFreeBatches.push(std::move(batch));
+    }
+
+    fWriterThread = std::thread([this]() {
+        std::vector<T> batch;
+        while (fFilledBatches.pop(batch))
+        {
+            fWriteBatch(batch);
+            batch.clear();
+            fFreeBatches.push(std::move(batch));
+        }
+    });
+}
+
+template <typename T>
+void AsyncBatchWriter<T>::push(const T& item)
+{
+    fCurrentBatch.push_back(item);
+    if (fCurrentBatch.size() >= fBatchSize)
+        flush();
+}
+
+template <typename T>
+void AsyncBatchWriter<T>::flush()
+{
+    if (fCurrentBatch.empty())
+        return;
+    if (!fAsync)
+    {
+        fWriteBatch(fCurrentBatch);
+        fCurrentBatch.clear();
+        return;
+    }
+
+    fFilledBatches.push(std::move(fCurrentBatch));
+    fFreeBatches.pop(fCurrentBatch);     // blocks until the writer releases a buffer
+}
+
+/**
+ * Write the pending items and wait until the writer thread is idle (e.g. before saving the output). Unlike finish,
+ * the writer can be used further.
+*/
+template <typename T>
+void AsyncBatchWriter<T>::sync()
+{
+    if (fFinished)
+        return;
+    flush();
+    if (!fAsync)
+        return;
+
+    // all the buffers but the current one are back in the free queue once the writer is done with them
+    std::vector<std::vector<T>> freeBatches(fNBuffers - 1);
+    for (auto& batch : freeBatches)
+        fFreeBatches.pop(batch);
+    for (auto& batch : freeBatches)
+        fFreeBatches.push(std::move(batch));
+}
+
+/**
+ * Write the pending items and wait for the writer thread
+*/
+template <typename T>
+void AsyncBatchWriter<T>::finish()
+{
+    if (fFinished)
+        return;
+    flush();
+    fFinished = true;
+    if (!fAsync)
+        return;
+    fFilledBatches.close();
+    fWriterThread.join();
+    fFreeBatches.close();
+}
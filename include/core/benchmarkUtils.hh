@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <Riostream.h>
+
+namespace benchmarkUtils {
+
+    /**
+     * Work processed by a single iteration of a benchmark, used to derive the throughput
+    */
+    struct BenchmarkCounters
+    {
+        double items = 0.;  // pairs, entries or candidates processed
+        double bytes = 0.;  // bytes read or written
+    };
+
+    struct BenchmarkResult
+    {
+        std::string name;
+        std::string itemLabel = "items";
+        long long iterations = 0;
+        double realTime = 0.;       // total wall time over all iterations (s)
+        double items = 0.;          // total items over all iterations
+        double bytes = 0.;          // total bytes over all iterations
+
+        double timePerIteration() const { return iterations > 0 ? realTime / iterations : 0.; }
+        double itemsPerSecond() const { return realTime > 0 ? items / realTime : 0.; }
+        double bytesPerSecond() const { return realTime > 0 ? bytes / realTime : 0.; }
+    };
+
+    /**
+     * Bounded-time benchmark runner.
+     * Each benchmark is repeated until minTime seconds have been accumulated or maxIterations is reached,
+     * whichever comes first. The benchmarked callable returns the BenchmarkCounters of one iteration.
+    */
+    class BenchmarkSuite
+    {
+        public:
+            BenchmarkSuite(const double minTime = 0.5, const long long maxIterations = 1000)
+                : fMinTime(minTime), fMaxIterations(maxIterations) {}
+            ~BenchmarkSuite() = default;
+
+            template <typename Func>
+            const BenchmarkResult& run(const char * name, const char * itemLabel, Func&& func);
+
+            void addContext(const std::string& key, const std::string& value) { fContext.emplace_back(key, value); }
+            void print() const;
+            void writeJson(const char * outputFileName) const;
+
+        private:
+            static std::string escape(const std::string& input);
+
+            double fMinTime = 0.5;
+            long long fMaxIterations = 1000;
+            std::vector<std::pair<std::string, std::string>> fContext;
+            std::vector<BenchmarkResult> fResults;
+    };
+
+    template <typename Func>
+    const BenchmarkResult& BenchmarkSuite::run(const char * name, const char * itemLabel, Func&& func)
+    {
+        BenchmarkResult result;
+        result.name = name;
+        result.itemLabel = itemLabel;
+
+        while ((result.realTime < fMinTime && result.iterations < fMaxIterations) || result.iterations == 0)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const BenchmarkCounters counters = func();
+            const auto stop = std::chrono::steady_clock::now();
+
+            result.realTime += std::chrono::duration<double>(stop - start).count();
+            result.items += counters.items;
+            result.bytes += counters.bytes;
+            result.iterations++;
+        }
+
+        std::cout << "Benchmark " << result.name << ": " << result.iterations << " iterations, "
+                  << result.timePerIteration() << " s/iteration, " << result.itemsPerSecond() << " "
+                  << result.itemLabel << "/s" << std::endl;
+
+        fResults.push_back(result);
+        return fResults.back();
+    }
+
+    void BenchmarkSuite::print() const
+    {
+        std::cout << "--------------------------------" << std::endl;
+        std::cout << "Benchmark summary" << std::endl;
+        for (const auto& result : fResults)
+        {
+            std::cout << "  " << result.name << ": " << result.timePerIteration() << " s/iteration, "
+                      << result.itemsPerSecond() << " " << result.itemLabel << "/s, "
+                      << result.bytesPerSecond() / (1024. * 1024.) << " MiB/s" << std::endl;
+        }
+        std::cout << "--------------------------------" << std::endl;
+    }
+
+    /**
+     * Write the results in a Google-Benchmark-like JSON layout, so that runs can be compared across versions
+    */
+    void BenchmarkSuite::writeJson(const char * outputFileName) const
+    {
+        std::ofstream outputFile(outputFileName);
+        if (!outputFile.is_open())
+        {
+            std::cerr << "Could not open benchmark output file: " << outputFileName << std::endl;
+            return;
+        }
+
+        const std::time_t now = std::time(nullptr);
+        char date[32];
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        outputFile << "{\n";
+        outputFile << "  \"context\": {\n";
+        outputFile << "    \"date\": \"" << date << "\"";
+        for (const auto& [key, value] : fContext)
+            outputFile << ",\n    \"" << escape(key) << "\": \"" << escape(value) << "\"";
+        outputFile << "\n  },\n";
+
+        outputFile << "  \"benchmarks\": [\n";
+        for (size_t iResult = 0; iResult < fResults.size(); iResult++)
+        {
+            const auto& result = fResults[iResult];
+            outputFile << "    {\n";
+            outputFile << "      \"name\": \"" << escape(result.name) << "\",\n";
+            outputFile << "      \"iterations\": " << result.iterations << ",\n";
+            outputFile << "      \"real_time\": " << result.timePerIteration() << ",\n";
+            outputFile << "      \"time_unit\": \"s\",\n";
+            outputFile << "      \"item_label\": \"" << escape(result.itemLabel) << "\",\n";
+            outputFile << "      \"items_per_second\": " << result.itemsPerSecond() << ",\n";
+            outputFile << "      \"bytes_per_second\": " << result.bytesPerSecond() << "\n";
+            outputFile << "    }" << (iResult + 1 < fResults.size() ? "," : "") << "\n";
+        }
+        outputFile << "  ]\n";
+        outputFile << "}\n";
+
+        std::cout << "Benchmark results written to " << outputFileName << std::endl;
+    }
+
+    std::string BenchmarkSuite::escape(const std::string& input)
+    {
+        std::string output;
+        for (const char c : input)
+        {
+            if (c == '"' || c == '\\')
+                output += '\\';
+            output += c;
+        }
+        return output;
+    }
+
+}   // namespace benchmarkUtils
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <Riostream.h>
+#include <TDirectory.h>
+#include <TH1I.h>
+#include <TH2I.h>
+
+#include "candidates.hh"
+#include "indexTableUtils.hh"
+
+/**
+ * Mixing pools obtained by merging neighbouring sparse z-vertex/centrality bins of HistVertexMultiplicity, so that
+ * each pool holds at least a target number of collisions. Neighbouring centrality classes are merged first until each
+ * group reaches the target, then the z-vertex bins of each group are merged the same way. A last group below the
+ * target is merged into the previous one. The overflow bin stays a pool of its own.
+ * The default-constructed merging keeps one pool per bin.
+*/
+class BinMerging
+{
+    public:
+        BinMerging() = default;
+        ~BinMerging() = default;
+
+        void build(const std::vector<int>& binCounts, const int minPoolCount);
+
+        inline int getPool(const int iBin) const { return fPoolOfBin.empty() ? iBin : fPoolOfBin[iBin]; }
+        inline int getNPools() const { return fPoolCounts.size(); }
+        inline bool isMerged() const { return !fPoolOfBin.empty(); }
+
+        std::vector<std::vector<CollHadBracket>> mergeBrackets(const std::vector<std::vector<CollHadBracket>>& binBrackets) const;
+        void printSummary() const;
+        void save(TDirectory * output) const;
+
+    private:
+        static std::vector<std::pair<int, int>> groupNeighbours(const std::vector<int>& counts, const int minCount);
+
+        HistVertexMultiplicity fBinning;
+        std::vector<int> fPoolOfBin;
+        std::vector<int> fPoolCounts;       // collisions per pool
+        int fMinPoolCount = 0;
+};
+
+/**
+ * Split [0, counts.size()) in consecutive groups [begin, end) holding at least minCount in total
+*/
+std::vector<std::pair<int, int>> BinMerging::groupNeighbours(const std::vector<int>& counts, const int minCount)
+{
+    std::vector<std::pair<int, int>> groups;
+    int begin = 0, sum = 0;
+    for (int i = 0; i < static_cast<int>(counts.size()); i++)
+    {
+        sum += counts[i];
+        if (sum >= minCount)
+        {
+            groups.emplace_back(begin, i + 1);
+            begin = i + 1;
+            sum = 0;
+        }
+    }
+    if (begin < static_cast<int>(counts.size()))
+    {
+        if (groups.empty())
+            groups.emplace_back(begin, counts.size());
+        else
+            groups.back().second = counts.size();
+    }
+    return groups;
+}
+
+/**
+ * @param binCounts Collisions in each bin of HistVertexMultiplicity::getBinIndex (overflow bin included)
+*/
+void BinMerging::build(const std::vector<int>& binCounts, const int minPoolCount)
+{
+    const int nZetaBins = fBinning.mZetaBins;
+    const int nMultBins = fBinning.mMultBins;
+    fMinPoolCount = minPoolCount;
+    fPoolOfBin.assign(nZetaBins * nMultBins + 1, -1);
+    fPoolCounts.clear();
+
+    std::vector<int> multCounts(nMultBins, 0);
+    for (int iMult = 0; iMult < nMultBins; iMult++)
+        for (int iZeta = 0; iZeta < nZetaBins; iZeta++)
+            multCounts[iMult] += binCounts[iZeta + nZetaBins * iMult];
+
+    for (const auto& [multBegin, multEnd] : groupNeighbours(multCounts, minPoolCount))
+    {
+        std::vector<int> zetaCounts(nZetaBins, 0);
+        for (int iMult = multBegin; iMult < multEnd; iMult++)
+            for (int iZeta = 0; iZeta < nZetaBins; iZeta++)
+                zetaCounts[iZeta] += binCounts[iZeta + nZetaBins * iMult];
+
+        for (const auto& [zetaBegin, zetaEnd] : groupNeighbours(zetaCounts, minPoolCount))
+        {
+            int poolCount = 0;
+            for (int iMult = multBegin; iMult < multEnd; iMult++)
+                for (int iZeta = zetaBegin; iZeta < zetaEnd; iZeta++)
+                {
+                    fPoolOfBin[iZeta + nZetaBins * iMult] = fPoolCounts.size();
+                    poolCount += binCounts[iZeta + nZetaBins * iMult];
+                }
+            fPoolCounts.push_back(poolCount);
+        }
+    }
+    fPoolOfBin[nZetaBins * nMultBins] = fPoolCounts.size();
+    fPoolCounts.push_back(binCounts[nZetaBins * nMultBins]);
+}
+
+/**
+ * Brackets of each pool: the brackets of its bins, in increasing bin order
+*/
+std::vector<std::vector<CollHadBracket>> BinMerging::mergeBrackets(const std::vector<std::vector<CollHadBracket>>& binBrackets) const
+{
+    if (!isMerged())
+        return binBrackets;
+
+    std::vector<std::vector<CollHadBracket>> poolBrackets(getNPools());
+    for (int iPool = 0; iPool < getNPools(); iPool++)
+        poolBrackets[iPool].reserve(fPoolCounts[iPool]);
+    for (size_t iBin = 0; iBin < binBrackets.size(); iBin++)
+    {
+        std::vector<CollHadBracket>& pool = poolBrackets[getPool(iBin)];
+        pool.insert(pool.end(), binBrackets[iBin].begin(), binBrackets[iBin].end());
+    }
+    return poolBrackets;
+}
+
+void BinMerging::printSummary() const
+{
+    if (!isMerged())
+        return;
+    // the overflow pool (last) is not counted
+    const auto minMax = std::minmax_element(fPoolCounts.begin(), fPoolCounts.end() - 1);
+    std::cout << "Merged " << fPoolOfBin.size() - 1 << " z-vertex/centrality bins into " << getNPools() - 1
+              << " pools of at least " << fMinPoolCount << " collisions (" << *minMax.first << " to "
+              << *minMax.second << " collisions per pool)" << std::endl;
+}
+
+/**
+ * Store the pool of each bin (z vertex, centrality) and the collisions per pool
+*/
+void BinMerging::save(TDirectory * output) const
+{
+    output->cd();
+
+    TH2I hPoolOfBin("hPoolOfBin", "; #it{z}_{vtx} (cm); Centrality FT0C (%); Pool",
+                    fBinning.mZetaBins, fBinning.minZeta, fBinning.maxZeta,
+                    fBinning.mMultBins, fBinning.minMult, fBinning.maxMult);
+    for (int iMult = 0; iMult < fBinning.mMultBins; iMult++)
+        for (int iZeta = 0; iZeta < fBinning.mZetaBins; iZeta++)
+            hPoolOfBin.SetBinContent(iZeta + 1, iMult + 1, getPool(iZeta + fBinning.mZetaBins * iMult));
+
+    TH1I hPoolCollisions("hPoolCollisions", "; Pool; Collisions", getNPools(), 0, getNPools());
+    for (int iPool = 0; iPool < getNPools(); iPool++)
+        hPoolCollisions.SetBinContent(iPool + 1, fPoolCounts[iPool]);
+
+    hPoolOfBin.Write();
+    hPoolCollisions.Write();
+}
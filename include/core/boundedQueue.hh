@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * Blocking FIFO with a maximum size, used to connect the stages of the pipeline.
+ * push() blocks while the queue is full (back-pressure on the producer), pop() blocks while it is empty and
+ * returns false once the queue has been closed and drained.
+*/
+template <typename T>
+class BoundedQueue
+{
+    public:
+        BoundedQueue(const size_t capacity) : fCapacity(capacity > 0 ? capacity : 1) {}
+        ~BoundedQueue() = default;
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator= (const BoundedQueue&) = delete;
+
+        bool push(T&& item);
+        bool pop(T& item);
+        void close();
+
+    private:
+        size_t fCapacity;
+        bool fClosed = false;
+        std::deque<T> fItems;
+        std::mutex fMutex;
+        std::condition_variable fNotFull;
+        std::condition_variable fNotEmpty;
+};
+
+/**
+ * @return false if the queue was closed (the item is dropped)
+*/
+template <typename T>
+bool BoundedQueue<T>::push(T&& item)
+{
+    std::unique_lock<std::mutex> lock(fMutex);
+    fNotFull.wait(lock, [this]() { return fItems.size() < fCapacity || fClosed; });
+    if (fClosed)
+        return false;
+    fItems.push_back(std::move(item));
+    lock.unlock();
+    fNotEmpty.notify_one();
+    return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::pop(T& item)
+{
+    std::unique_lock<std::mutex> lock(fMutex);
+    fNotEmpty.wait(lock, [this]() { return !fItems.empty() || fClosed; });
+    if (fItems.empty())
+        return false;
+    item = std::move(fItems.front());
+    fItems.pop_front();
+    lock.unlock();
+    fNotFull.notify_one();
+    return true;
+}
+
+template <typename T>
+void BoundedQueue<T>::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fClosed = true;
+    }
+    fNotFull.notify_all();
+    fNotEmpty.notify_all();
+}
@@ -13,21 +13,29 @@ class Candidate
 };
 
 /**
- * Structure to define the brackets of hadrons in a given collision (indices of hadrons produced in the same collision)
+ * Structure to define the brackets of hadrons in a given collision (indices of hadrons produced in the same collision).
+ * The hadrons of a bracket are ordered by charge, the negative ones in [min, split) and the positive ones in [split, max],
+ * and by rapidity within each charge.
 */
 struct CollHadBracket
 {
-    int CollID, fHadStartIndex = -1, fHadEndIndex = -1;
+    int CollID, fHadStartIndex = -1, fHadEndIndex = -1, fHadSplitIndex = -1;
     void SetMin(int min) {
         fHadStartIndex = min;
     }
     void SetMax(int max) {
         fHadEndIndex = max;
     }
-    int GetMin() {
+    void SetSplit(int split) {
+        fHadSplitIndex = split;
+    }
+    int GetMin() const {
         return fHadStartIndex;
     }
-    int GetMax() {
+    int GetMax() const {
         return fHadEndIndex;
     }
+    int GetSplit() const {
+        return fHadSplitIndex;
+    }
 };
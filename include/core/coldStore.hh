@@ -0,0 +1,146 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <Riostream.h>
+#include <TBranch.h>
+#include <TTree.h>
+
+enum class ColdStorage {
+    kMemory = 0,    // cold fields copied in memory at ingestion
+    kDisk = 1,      // only the input entry is kept, cold fields are read back from the input tree when requested
+    kPacked = 2     // cold fields quantised in memory at ingestion (Cold::Packed), unpacked when requested
+};
+
+/**
+ * Storage of the cold tier of the candidates: fields that are only needed when a pair is written.
+ * Candidates refer to their cold fields by the index returned by add().
+ * In kDisk mode the input tree must stay open until the last get(); the cold branches are disabled during
+ * ingestion (disableBranches) and only the requested branches are read back, entry by entry. Inputs other than
+ * trees provide the reading function with setSource instead.
+ * In kPacked mode get() unpacks into a buffer of the calling thread, so that concurrent readers are allowed as in
+ * kMemory mode; the reference is valid until the next get() of the same thread.
+ * Cold must derive from Candidate and provide a static branchNames(), and a Packed type with Packed pack() const and
+ * void unpack(const Packed&).
+*/
+template <typename Cold>
+class ColdStore
+{
+    public:
+        ColdStore(const ColdStorage storage = ColdStorage::kMemory) : fStorage(storage) {}
+        ~ColdStore() = default;
+        ColdStore(const ColdStore&) = delete;
+        ColdStore& operator= (const ColdStore&) = delete;
+
+        inline ColdStorage getStorage() const { return fStorage; }
+        /**
+         * Change the storage mode of an empty store (e.g. to fit a memory budget before ingestion)
+         * @return false if the store already holds cold fields
+        */
+        bool setStorage(const ColdStorage storage)
+        {
+            if (size() > 0)
+                return false;
+            fStorage = storage;
+            return true;
+        }
+        inline bool readsAtIngestion() const { return fStorage != ColdStorage::kDisk; }
+
+        void disableBranches(TTree * tree);
+        void setSource(std::function<void(const Long64_t, Cold&)> readCold) { fReadCold = readCold; }
+        int add(const Cold& cold, const Long64_t entry);
+        const Cold& get(const int index);
+
+        size_t size() const { return fColdFields.size() + fPackedFields.size() + fEntries.size(); }
+        size_t getMemoryBytes() const
+        {
+            return fColdFields.capacity() * sizeof(Cold) + fPackedFields.capacity() * sizeof(typename Cold::Packed) +
+                   fEntries.capacity() * sizeof(Long64_t);
+        }
+        void clear() { fColdFields.clear(); fPackedFields.clear(); fEntries.clear(); fBufferEntry = -1; }
+
+    private:
+        void bindBranches();
+
+        ColdStorage fStorage = ColdStorage::kMemory;
+        std::vector<Cold> fColdFields;          // kMemory
+        std::vector<typename Cold::Packed> fPackedFields;   // kPacked
+        std::vector<Long64_t> fEntries;         // kDisk
+
+        TTree * fTree = nullptr;                // kDisk
+        std::function<void(const Long64_t, Cold&)> fReadCold;
+        std::vector<TBranch *> fBranches;
+        Cold fBuffer;
+        Long64_t fBufferEntry = -1;
+};
+
+template <typename Cold>
+void ColdStore<Cold>::disableBranches(TTree * tree)
+{
+    if (fStorage != ColdStorage::kDisk)
+        return;
+    fTree = tree;
+    fBranches.clear();
+    for (const char * branchName : Cold::branchNames())
+        fTree->SetBranchStatus(branchName, false);
+}
+
+template <typename Cold>
+int ColdStore<Cold>::add(const Cold& cold, const Long64_t entry)
+{
+    if (fStorage == ColdStorage::kMemory)
+    {
+        fColdFields.push_back(cold);
+        return fColdFields.size() - 1;
+    }
+    if (fStorage == ColdStorage::kPacked)
+    {
+        fPackedFields.push_back(cold.pack());
+        return fPackedFields.size() - 1;
+    }
+    fEntries.push_back(entry);
+    return fEntries.size() - 1;
+}
+
+template <typename Cold>
+const Cold& ColdStore<Cold>::get(const int index)
+{
+    if (fStorage == ColdStorage::kMemory)
+        return fColdFields[index];
+    if (fStorage == ColdStorage::kPacked)
+    {
+        thread_local Cold unpacked;
+        unpacked.unpack(fPackedFields[index]);
+        return unpacked;
+    }
+
+    const Long64_t entry = fEntries[index];
+    if (entry == fBufferEntry)
+        return fBuffer;
+    fBufferEntry = entry;
+    if (fReadCold)
+    {
+        fReadCold(entry, fBuffer);
+        return fBuffer;
+    }
+    if (fBranches.empty())
+        bindBranches();
+    for (TBranch * branch : fBranches)
+        branch->GetEntry(entry);
+    return fBuffer;
+}
+
+template <typename Cold>
+void ColdStore<Cold>::bindBranches()
+{
+    if (!fTree)
+    {
+        std::cerr << "ColdStore: no input tree attached, call disableBranches before ingestion" << std::endl;
+        return;
+    }
+    for (const char * branchName : Cold::branchNames())
+        fTree->SetBranchStatus(branchName, true);
+    fBuffer.setBranchAddress(fTree);
+    for (const char * branchName : Cold::branchNames())
+        fBranches.push_back(fTree->GetBranch(branchName));
+}
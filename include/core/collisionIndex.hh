@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <TTree.h>
+#include <TDirectory.h>
+
+#include "parallelUtils.hh"
+
+namespace collisionIndex {
+
+    const char * kDFEntryOffsetsName = "DFEntryOffsets";
+
+    /**
+     * Identity of the collision an entry belongs to.
+     * The z vertex and centrality are compared bit by bit, so only entries copied from the same collision row match.
+     * The data frame (DF) index separates collisions of different DFs, the explicit index (if available) is exact.
+    */
+    struct CollisionKey
+    {
+        uint32_t fZBits = 0, fCentralityBits = 0;
+        int fDFIndex = 0;
+        long long fIndex = -1;
+
+        bool operator== (const CollisionKey& other) const
+        {
+            return fZBits == other.fZBits && fCentralityBits == other.fCentralityBits &&
+                   fDFIndex == other.fDFIndex && fIndex == other.fIndex;
+        }
+        bool operator!= (const CollisionKey& other) const { return !(*this == other); }
+    };
+
+    inline uint32_t floatBits(const float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    /**
+     * Collision index of each entry: entries belonging to the same collision must be contiguous, a new collision
+     * starts wherever the key changes. Computed by a parallel prefix sum over the key boundaries.
+     * @return number of collisions
+    */
+    int buildCollisionIndex(const std::vector<CollisionKey>& keys, std::vector<int>& collisionIndices)
+    {
+        return parallelUtils::labelSegments(keys.size(), [&keys](const size_t i) { return keys[i] != keys[i - 1]; },
+                                            collisionIndices);
+    }
+
+    /**
+     * First entry of each data frame in a merged tree, as written by treeUtils::treeMerging (empty if not available)
+    */
+    std::vector<Long64_t> readDFEntryOffsets(TTree * tree)
+    {
+        std::vector<Long64_t> offsets;
+        TDirectory * directory = tree->GetDirectory();
+        if (!directory)
+            return offsets;
+        // Get returns a new object, owned by the caller
+        std::unique_ptr<std::vector<Long64_t>> storedOffsets(directory->Get<std::vector<Long64_t>>(kDFEntryOffsetsName));
+        if (storedOffsets)
+            offsets = std::move(*storedOffsets);
+        return offsets;
+    }
+
+    inline int getDFIndex(const std::vector<Long64_t>& dfEntryOffsets, const Long64_t iEntry)
+    {
+        if (dfEntryOffsets.empty())
+            return 0;
+        return static_cast<int>(std::upper_bound(dfEntryOffsets.begin(), dfEntryOffsets.end(), iEntry) - dfEntryOffsets.begin()) - 1;
+    }
+
+}   // namespace collisionIndex
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <Riostream.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Flat columnar binary format: a header, a table of column descriptors and fixed-width columns, each starting
+ * on a 64-byte boundary. Values are stored in the native byte order, the files are meant as a local cache of the
+ * ROOT input, not for exchange between machines.
+*/
+namespace columnar {
+
+    const char kMagic[8] = {'E', 'M', 'C', 'O', 'L', 'U', 'M', 'N'};
+    const uint32_t kVersion = 1;
+    const uint64_t kAlignment = 64;
+
+    enum ColumnType : uint32_t {
+        kFloat = 0,
+        kInt,
+        kUInt,
+        kUChar,
+        kLong64
+    };
+
+    template <typename T> struct ColumnTypeOf;
+    template <> struct ColumnTypeOf<float> { static constexpr ColumnType value = kFloat; };
+    template <> struct ColumnTypeOf<int> { static constexpr ColumnType value = kInt; };
+    template <> struct ColumnTypeOf<unsigned int> { static constexpr ColumnType value = kUInt; };
+    template <> struct ColumnTypeOf<unsigned char> { static constexpr ColumnType value = kUChar; };
+    template <> struct ColumnTypeOf<long long> { static constexpr ColumnType value = kLong64; };
+
+    struct FileHeader
+    {
+        char fMagic[8];
+        uint32_t fVersion;
+        uint32_t fNColumns;
+        uint64_t fNRows;
+        uint64_t fReserved;
+    };
+
+    struct ColumnDescriptor
+    {
+        char fName[44];
+        uint32_t fType;
+        uint32_t fElementSize;
+        uint32_t fReserved;
+        uint64_t fOffset;       // from the beginning of the file
+    };
+
+    inline uint64_t alignOffset(const uint64_t offset) { return (offset + kAlignment - 1) / kAlignment * kAlignment; }
+
+}   // namespace columnar
+
+/**
+ * Read-only view of a column of a mapped file (no copy)
+*/
+template <typename T>
+class ColumnView
+{
+    public:
+        ColumnView() = default;
+        ColumnView(const T * data, const size_t size) : fData(data), fSize(size) {}
+
+        inline const T& operator[] (const size_t i) const { return fData[i]; }
+        inline const T * data() const { return fData; }
+        inline size_t size() const { return fSize; }
+        inline bool empty() const { return fSize == 0; }
+
+    private:
+        const T * fData = nullptr;
+        size_t fSize = 0;
+};
+
+/**
+ * Writes a columnar file row chunk by row chunk, so that only a chunk of the columns is held in memory.
+ * The columns are declared with addColumn, then open writes the header and the column table for nRows rows and
+ * writeRows writes consecutive rows of a column at their offset in the file.
+*/
+class ColumnarWriter
+{
+    public:
+        ColumnarWriter() = default;
+        ~ColumnarWriter() = default;
+
+        /**
+         * @return index of the column, used by writeRows
+        */
+        template <typename T>
+        int addColumn(const std::string& name);
+        bool open(const std::string& fileName, const uint64_t nRows);
+        template <typename T>
+        void writeRows(const int iColumn, const uint64_t firstRow, const T * values, const uint64_t nValues);
+        bool close();
+
+    private:
+        std::vector<columnar::ColumnDescriptor> fDescriptors;
+        uint64_t fNRows = 0;
+        std::ofstream fOutput;
+        std::string fFileName;
+};
+
+template <typename T>
+int ColumnarWriter::addColumn(const std::string& name)
+{
+    if (name.size() >= sizeof(columnar::ColumnDescriptor::fName))
+    {
+        std::cerr << "ColumnarWriter: column name too long: " << name << std::endl;
+        return -1;
+    }
+    columnar::ColumnDescriptor descriptor{};
+    std::strncpy(descriptor.fName, name.c_str(), sizeof(descriptor.fName) - 1);
+    descriptor.fType = columnar::ColumnTypeOf<T>::value;
+    descriptor.fElementSize = sizeof(T);
+    fDescriptors.push_back(descriptor);
+    return fDescriptors.size() - 1;
+}
+
+/**
+ * Write the header and the column table, and extend the file to its final size (the padding reads as zeros)
+*/
+bool ColumnarWriter::open(const std::string& fileName, const uint64_t nRows)
+{
+    fFileName = fileName;
+    fNRows = nRows;
+    fOutput.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!fOutput)
+    {
+        std::cerr << "ColumnarWriter: cannot open " << fileName << std::endl;
+        return false;
+    }
+
+    columnar::FileHeader header{};
+    std::memcpy(header.fMagic, columnar::kMagic, sizeof(header.fMagic));
+    header.fVersion = columnar::kVersion;
+    header.fNColumns = fDescriptors.size();
+    header.fNRows = fNRows;
+
+    uint64_t offset = columnar::alignOffset(sizeof(header) + fDescriptors.size() * sizeof(columnar::ColumnDescriptor));
+    for (auto& descriptor : fDescriptors)
+    {
+        descriptor.fOffset = offset;
+        offset = columnar::alignOffset(offset + fNRows * descriptor.fElementSize);
+    }
+
+    fOutput.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    fOutput.write(reinterpret_cast<const char *>(fDescriptors.data()), fDescriptors.size() * sizeof(columnar::ColumnDescriptor));
+    if (offset > static_cast<uint64_t>(fOutput.tellp()))
+    {
+        fOutput.seekp(offset - 1);
+        fOutput.put(0);
+    }
+    return static_cast<bool>(fOutput);
+}
+
+template <typename T>
+void ColumnarWriter::writeRows(const int iColumn, const uint64_t firstRow, const T * values, const uint64_t nValues)
+{
+    const columnar::ColumnDescriptor& descriptor = fDescriptors[iColumn];
+    if (descriptor.fElementSize != sizeof(T) || firstRow + nValues > fNRows)
+    {
+        std::cerr << "ColumnarWriter: invalid rows " << firstRow << "-" << firstRow + nValues << " of column "
+                  << descriptor.fName << std::endl;
+        fOutput.setstate(std::ios::failbit);
+        return;
+    }
+    fOutput.seekp(descriptor.fOffset + firstRow * sizeof(T));
+    fOutput.write(reinterpret_cast<const char *>(values), nValues * sizeof(T));
+}
+
+/**
+ * @return false if any write failed
+*/
+bool ColumnarWriter::close()
+{
+    fOutput.close();
+    if (!fOutput)
+    {
+        std::cerr << "ColumnarWriter: error writing " << fFileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Columnar file mapped in memory (read only). Column views point directly into the mapping and stay valid as
+ * long as the file is open.
+*/
+class MappedColumnarFile
+{
+    public:
+        MappedColumnarFile() = default;
+        MappedColumnarFile(const std::string& fileName) { open(fileName); }
+        ~MappedColumnarFile() { close(); }
+        MappedColumnarFile(const MappedColumnarFile&) = delete;
+        MappedColumnarFile& operator= (const MappedColumnarFile&) = delete;
+
+        bool open(const std::string& fileName);
+        void close();
+
+        inline bool isOpen() const { return fData != nullptr; }
+        inline uint64_t getNRows() const { return fHeader ? fHeader->fNRows : 0; }
+        inline size_t getSize() const { return fSize; }
+        bool hasColumn(const std::string& name) const { return findColumn(name) != nullptr; }
+
+        template <typename T>
+        ColumnView<T> column(const std::string& name) const;
+
+    private:
+        const columnar::ColumnDescriptor * findColumn(const std::string& name) const;
+
+        const char * fData = nullptr;
+        size_t fSize = 0;
+        const columnar::FileHeader * fHeader = nullptr;
+        const columnar::ColumnDescriptor * fDescriptors = nullptr;
+};
+
+bool MappedColumnarFile::open(const std::string& fileName)
+{
+    close();
+    const int fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+    if (fileDescriptor < 0)
+    {
+        std::cerr << "MappedColumnarFile: cannot open " << fileName << std::endl;
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(columnar::FileHeader))
+    {
+        std::cerr << "MappedColumnarFile: " << fileName << " is not a columnar file" << std::endl;
+        ::close(fileDescriptor);
+        return false;
+    }
+    fSize = fileStat.st_size;
+    void * mapping = mmap(nullptr, fSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    ::close(fileDescriptor);
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "MappedColumnarFile: cannot map " << fileName << std::endl;
+        fSize = 0;
+        return false;
+    }
+    fData = static_cast<const char *>(mapping);
+    madvise(mapping, fSize, MADV_SEQUENTIAL);
+
+    fHeader = reinterpret_cast<const columnar::FileHeader *>(fData);
+    fDescriptors = reinterpret_cast<const columnar::ColumnDescriptor *>(fData + sizeof(columnar::FileHeader));
+    const bool isValid = std::memcmp(fHeader->fMagic, columnar::kMagic, sizeof(columnar::kMagic)) == 0 &&
+                         fHeader->fVersion == columnar::kVersion &&
+                         sizeof(columnar::FileHeader) + fHeader->fNColumns * sizeof(columnar::ColumnDescriptor) <= fSize;
+    if (!isValid)
+    {
+        std::cerr << "MappedColumnarFile: " << fileName << " is not a columnar file (version " << columnar::kVersion << ")" << std::endl;
+        close();
+        return false;
+    }
+    for (uint32_t iColumn = 0; iColumn < fHeader->fNColumns; iColumn++)
+    {
+        if (fDescriptors[iColumn].fOffset + fHeader->fNRows * fDescriptors[iColumn].fElementSize > fSize)
+        {
+            std::cerr << "MappedColumnarFile: " << fileName << " is truncated" << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void MappedColumnarFile::close()
+{
+    if (fData)
+        munmap(const_cast<char *>(fData), fSize);
+    fData = nullptr;
+    fSize = 0;
+    fHeader = nullptr;
+    fDescriptors = nullptr;
+}
+
+const columnar::ColumnDescriptor * MappedColumnarFile::findColumn(const std::string& name) const
+{
+    if (!fHeader)
+        return nullptr;
+    for (uint32_t iColumn = 0; iColumn < fHeader->fNColumns; iColumn++)
+        if (name == fDescriptors[iColumn].fName)
+            return &fDescriptors[iColumn];
+    return nullptr;
+}
+
+/**
+ * @return empty view if the column does not exist or has a different type
+*/
+template <typename T>
+ColumnView<T> MappedColumnarFile::column(const std::string& name) const
+{
+    const columnar::ColumnDescriptor * descriptor = findColumn(name);
+    if (!descriptor)
+    {
+        std::cerr << "MappedColumnarFile: no column " << name << std::endl;
+        return ColumnView<T>();
+    }
+    if (descriptor->fType != columnar::ColumnTypeOf<T>::value || descriptor->fElementSize != sizeof(T))
+    {
+        std::cerr << "MappedColumnarFile: column " << name << " has a different type" << std::endl;
+        return ColumnView<T>();
+    }
+    return ColumnView<T>(reinterpret_cast<const T *>(fData + descriptor->fOffset), fHeader->fNRows);
+}
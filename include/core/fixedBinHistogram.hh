@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <Riostream.h>
+#include <TH1.h>
+
+/**
+ * Unweighted one-dimensional histogram with uniform bins, filled without ROOT: the bin is found with the same
+ * expression as TAxis::FindFixBin and the statistics are accumulated as in TH1::Fill (under- and overflow entries
+ * only count in the number of entries). Instances are not shared between threads: each thread fills its own and the
+ * partial histograms are summed with add, then converted to a TH1 once.
+ * Counts are integers, so bins above 2^24 entries are exact (a TH1F saturates there when filled one by one).
+*/
+class FixedBinHistogram
+{
+    public:
+        FixedBinHistogram(const int nBins, const double xMin, const double xMax);
+        ~FixedBinHistogram() = default;
+
+        /**
+         * Add n entries at x (same as n calls of TH1::Fill(x))
+        */
+        inline void fill(const double x, const uint64_t n = 1);
+        void add(const FixedBinHistogram& other);
+        bool add(const TH1 * hist);
+        void reset();
+
+        inline int getNBins() const { return fNBins; }
+        inline double getXMin() const { return fXMin; }
+        inline double getXMax() const { return fXMax; }
+        inline uint64_t getBinCount(const int iBin) const { return fCounts[iBin]; }
+        inline uint64_t getEntries() const { return fEntries; }
+
+        void fillTH1(TH1 * hist) const;
+
+    private:
+        int fNBins;
+        double fXMin;
+        double fXMax;
+        std::vector<uint64_t> fCounts;      // underflow (0), bins (1 to nBins), overflow (nBins + 1)
+        uint64_t fEntries = 0;
+        double fSumW = 0.;                  // in-range entries
+        double fSumWX = 0.;
+        double fSumWX2 = 0.;
+};
+
+FixedBinHistogram::FixedBinHistogram(const int nBins, const double xMin, const double xMax):
+    fNBins(nBins), fXMin(xMin), fXMax(xMax), fCounts(nBins + 2, 0)
+{
+}
+
+void FixedBinHistogram::fill(const double x, const uint64_t n)
+{
+    fEntries += n;
+    int iBin;
+    if (x < fXMin)
+        iBin = 0;
+    else if (!(x < fXMax))
+        iBin = fNBins + 1;
+    else
+        iBin = 1 + int(fNBins * (x - fXMin) / (fXMax - fXMin));
+    fCounts[iBin] += n;
+    if (iBin == 0 || iBin > fNBins)
+        return;
+    fSumW += n;
+    fSumWX += n * x;
+    fSumWX2 += n * x * x;
+}
+
+void FixedBinHistogram::add(const FixedBinHistogram& other)
+{
+    for (int iBin = 0; iBin < fNBins + 2; iBin++)
+        fCounts[iBin] += other.fCounts[iBin];
+    fEntries += other.fEntries;
+    fSumW += other.fSumW;
+    fSumWX += other.fSumWX;
+    fSumWX2 += other.fSumWX2;
+}
+
+/**
+ * Add an unweighted histogram with the same binning (e.g. one written by fillTH1)
+ * @return false if the binning differs
+*/
+bool FixedBinHistogram::add(const TH1 * hist)
+{
+    TAxis * axis = const_cast<TH1 *>(hist)->GetXaxis();
+    if (hist->GetNbinsX() != fNBins || axis->GetXmin() != fXMin || axis->GetXmax() != fXMax)
+    {
+        std::cerr << "FixedBinHistogram: binning of " << hist->GetName() << " does not match" << std::endl;
+        return false;
+    }
+    for (int iBin = 0; iBin < fNBins + 2; iBin++)
+        fCounts[iBin] += std::llround(hist->GetBinContent(iBin));
+    double stats[4];
+    hist->GetStats(stats);
+    fEntries += std::llround(hist->GetEntries());
+    fSumW += stats[0];
+    fSumWX += stats[2];
+    fSumWX2 += stats[3];
+    return true;
+}
+
+void FixedBinHistogram::reset()
+{
+    std::fill(fCounts.begin(), fCounts.end(), 0);
+    fEntries = 0;
+    fSumW = fSumWX = fSumWX2 = 0.;
+}
+
+/**
+ * Write the contents and the statistics into a histogram with the same binning.
+ * The statistics are set after the contents, since SetBinContent resets them.
+*/
+void FixedBinHistogram::fillTH1(TH1 * hist) const
+{
+    for (int iBin = 0; iBin < fNBins + 2; iBin++)
+        hist->SetBinContent(iBin, fCounts[iBin]);
+    double stats[4] = {fSumW, fSumW, fSumWX, fSumWX2};
+    hist->PutStats(stats);
+    hist->SetEntries(fEntries);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * IEEE 754 half precision (binary16) conversions, used for the packed storage of output-only fields.
+ * Rounding is to the nearest even value: the relative error is at most 2^-11 (about 4.9e-4) for magnitudes between
+ * 6.1e-5 and 65504, smaller values lose precision (subnormals, absolute step 6e-8) and larger ones become infinite.
+ * Zero, infinities and NaN are preserved, as are integers up to 2048.
+*/
+namespace halfFloat {
+
+    const float kMax = 65504.f;
+    const float kRelativeResolution = 4.8828125e-4f;    // 2^-11
+
+    inline uint16_t fromFloat(const float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = (bits >> 16) & 0x8000;
+        const uint32_t absBits = bits & 0x7fffffff;
+
+        if (absBits >= 0x7f800000)          // infinity or NaN (quiet)
+            return sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0);
+        if (absBits >= 0x477ff000)          // rounds above kMax
+            return sign | 0x7c00;
+        if (absBits < 0x38800000)           // below the smallest normal half (2^-14): multiple of 2^-24
+        {
+            float magnitude;
+            std::memcpy(&magnitude, &absBits, sizeof(magnitude));
+            return sign | static_cast<uint16_t>(std::nearbyint(magnitude * 16777216.f));
+        }
+        // rebias the exponent (127 -> 15) and round the mantissa from 23 to 10 bits, ties to even
+        const uint32_t rounded = absBits + 0xfff + ((absBits >> 13) & 1);
+        return sign | static_cast<uint16_t>((rounded - 0x38000000) >> 13);
+    }
+
+    inline float toFloat(const uint16_t half)
+    {
+        const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+        const uint32_t exponent = (half >> 10) & 0x1f;
+        const uint32_t mantissa = half & 0x3ff;
+        if (exponent == 0)
+        {
+            const float magnitude = mantissa * 5.9604644775390625e-8f;     // 2^-24
+            return sign ? -magnitude : magnitude;
+        }
+        const uint32_t bits = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13)
+                                               : sign | ((exponent + 112) << 23) | (mantissa << 13);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+}   // namespace halfFloat
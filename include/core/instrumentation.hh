@@ -0,0 +1,216 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <Riostream.h>
+#include <TDirectory.h>
+#include <TH1D.h>
+
+namespace instrumentation {
+
+    enum Stage {
+        kIngestion = 0,         // reading the input trees
+        kCuts,                  // candidate selections
+        kBinning,               // z-vertex/centrality binning and bracket building
+        kMixing,                // full mixing loop (includes kPairKinematics and kOutput)
+        kPairKinematics,        // pair variables (invariant mass, ...)
+        kOutput,                // output tree filling and writing
+        kNStages
+    };
+
+    enum Counter {
+        kEntriesRead = 0,
+        kEntriesRejectedCuts,
+        kEntriesSkippedShard,
+        kHe3Processed,
+        kPairsGenerated,
+        kPairsRejectedSameCollision,
+        kPairsRejectedHadronCap,
+        kPairsRejectedKstar,
+        kMixingDepthNotReached,
+        kNCounters
+    };
+
+    const char * kStageNames[kNStages] = {"ingestion", "cuts", "binning", "mixing", "pair kinematics", "output"};
+    const char * kCounterNames[kNCounters] = {"entries read", "entries rejected (cuts)",
+                                              "entries skipped (shard)", "He3 processed",
+                                              "pairs generated", "pairs rejected (same collision)",
+                                              "pairs rejected (hadron cap)", "pairs rejected (k*)",
+                                              "mixing depth not reached"};
+
+    using Clock = std::chrono::steady_clock;
+
+}   // namespace instrumentation
+
+/**
+ * Lightweight per-stage timers and counters.
+ * Stage times are accumulated wall-clock times, stages can be nested (e.g. kPairKinematics inside kMixing).
+*/
+class Instrumentation
+{
+    public:
+        Instrumentation() { reset(); }
+        ~Instrumentation() = default;
+
+        inline void addTime(const instrumentation::Stage stage, const double seconds) { fStageTimes[stage] += seconds; fStageCalls[stage]++; }
+        inline void count(const instrumentation::Counter counter, const long long increment = 1) { fCounters[counter] += increment; }
+        inline double getTime(const instrumentation::Stage stage) const { return fStageTimes[stage]; }
+        inline long long getCount(const instrumentation::Counter counter) const { return fCounters[counter]; }
+
+        void reset();
+        void printSummary() const;
+        void saveSummary(TDirectory * output) const;
+        void addSummary(TDirectory * input);
+
+    private:
+        std::array<double, instrumentation::kNStages> fStageTimes;
+        std::array<long long, instrumentation::kNStages> fStageCalls;
+        std::array<long long, instrumentation::kNCounters> fCounters;
+};
+
+void Instrumentation::reset()
+{
+    fStageTimes.fill(0.);
+    fStageCalls.fill(0);
+    fCounters.fill(0);
+}
+
+void Instrumentation::printSummary() const
+{
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Instrumentation summary" << std::endl;
+    for (int iStage = 0; iStage < instrumentation::kNStages; iStage++)
+    {
+        std::cout << "  " << instrumentation::kStageNames[iStage] << ": " << fStageTimes[iStage] << " s ("
+                  << fStageCalls[iStage] << " calls)" << std::endl;
+    }
+    for (int iCounter = 0; iCounter < instrumentation::kNCounters; iCounter++)
+    {
+        std::cout << "  " << instrumentation::kCounterNames[iCounter] << ": " << fCounters[iCounter] << std::endl;
+    }
+    const double mixingTime = fStageTimes[instrumentation::kMixing];
+    if (mixingTime > 0)
+    {
+        std::cout << "  mixing throughput: " << fCounters[instrumentation::kPairsGenerated] / mixingTime
+                  << " pairs/s" << std::endl;
+    }
+    std::cout << "--------------------------------" << std::endl;
+}
+
+/**
+ * Store the stage times (s) and the counters as labelled histograms
+*/
+void Instrumentation::saveSummary(TDirectory * output) const
+{
+    output->cd();
+
+    TH1D hStageTimes("hStageTimes", "; ; Real time (s)", instrumentation::kNStages, 0, instrumentation::kNStages);
+    for (int iStage = 0; iStage < instrumentation::kNStages; iStage++)
+    {
+        hStageTimes.GetXaxis()->SetBinLabel(iStage + 1, instrumentation::kStageNames[iStage]);
+        hStageTimes.SetBinContent(iStage + 1, fStageTimes[iStage]);
+    }
+
+    TH1D hCounters("hCounters", "; ; Counts", instrumentation::kNCounters, 0, instrumentation::kNCounters);
+    for (int iCounter = 0; iCounter < instrumentation::kNCounters; iCounter++)
+    {
+        hCounters.GetXaxis()->SetBinLabel(iCounter + 1, instrumentation::kCounterNames[iCounter]);
+        hCounters.SetBinContent(iCounter + 1, fCounters[iCounter]);
+    }
+
+    hStageTimes.Write();
+    hCounters.Write();
+}
+
+/**
+ * Add a summary written by saveSummary (e.g. from a partial output), stage times of the inputs are summed
+*/
+void Instrumentation::addSummary(TDirectory * input)
+{
+    TH1D * hStageTimes = (TH1D *)input->Get("hStageTimes");
+    TH1D * hCounters = (TH1D *)input->Get("hCounters");
+    if (!hStageTimes || !hCounters || hStageTimes->GetNbinsX() != instrumentation::kNStages ||
+        hCounters->GetNbinsX() != instrumentation::kNCounters)
+    {
+        std::cerr << "Missing or incompatible instrumentation summary in " << input->GetName() << std::endl;
+        return;
+    }
+
+    for (int iStage = 0; iStage < instrumentation::kNStages; iStage++)
+        fStageTimes[iStage] += hStageTimes->GetBinContent(iStage + 1);
+    for (int iCounter = 0; iCounter < instrumentation::kNCounters; iCounter++)
+        fCounters[iCounter] += static_cast<long long>(hCounters->GetBinContent(iCounter + 1));
+}
+
+/**
+ * Adds the time spent in its scope to a stage of the instrumentation
+*/
+class ScopedTimer
+{
+    public:
+        ScopedTimer(Instrumentation& instrumentation, const instrumentation::Stage stage)
+            : fInstrumentation(instrumentation), fStage(stage), fStart(instrumentation::Clock::now()) {}
+        ~ScopedTimer()
+        {
+            fInstrumentation.addTime(fStage, std::chrono::duration<double>(instrumentation::Clock::now() - fStart).count());
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator= (const ScopedTimer&) = delete;
+
+    private:
+        Instrumentation& fInstrumentation;
+        instrumentation::Stage fStage;
+        instrumentation::Clock::time_point fStart;
+};
+
+/**
+ * Periodic progress line with rate and estimated time to completion.
+ * A line is printed at most every reportInterval seconds and always at the end.
+*/
+class ProgressReporter
+{
+    public:
+        ProgressReporter(const char * label, const size_t total, const double reportInterval = 10.)
+            : fLabel(label), fTotal(total), fReportInterval(reportInterval),
+              fStart(instrumentation::Clock::now()), fLastReport(fStart) {}
+        ~ProgressReporter() = default;
+
+        void update(const size_t processed, const long long nPairs);
+        void finish(const long long nPairs);
+
+    private:
+        void report(const size_t processed, const long long nPairs, const instrumentation::Clock::time_point now);
+
+        const char * fLabel;
+        size_t fTotal = 0;
+        double fReportInterval = 10.;
+        instrumentation::Clock::time_point fStart;
+        instrumentation::Clock::time_point fLastReport;
+};
+
+void ProgressReporter::update(const size_t processed, const long long nPairs)
+{
+    const auto now = instrumentation::Clock::now();
+    if (std::chrono::duration<double>(now - fLastReport).count() < fReportInterval)
+        return;
+    report(processed, nPairs, now);
+}
+
+void ProgressReporter::finish(const long long nPairs)
+{
+    report(fTotal, nPairs, instrumentation::Clock::now());
+}
+
+void ProgressReporter::report(const size_t processed, const long long nPairs, const instrumentation::Clock::time_point now)
+{
+    fLastReport = now;
+    const double elapsed = std::chrono::duration<double>(now - fStart).count();
+    const double fraction = fTotal > 0 ? static_cast<double>(processed) / fTotal : 1.;
+    const double rate = elapsed > 0 ? processed / elapsed : 0.;
+    const double pairRate = elapsed > 0 ? nPairs / elapsed : 0.;
+    const double eta = rate > 0 ? (fTotal - processed) / rate : 0.;
+
+    std::cout << "Processing " << fLabel << " " << processed << " / " << fTotal << " ("
+              << static_cast<int>(fraction * 100) << "%), " << rate << " " << fLabel << "/s, "
+              << pairRate << " pairs/s, elapsed " << elapsed << " s, ETA " << eta << " s" << std::endl;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include <Riostream.h>
+
+/**
+ * Tabulated version of a smooth one-dimensional function on a uniform grid, with linear or cubic (Catmull-Rom)
+ * interpolation. The grid is refined when the table is built until the relative difference to the function, checked
+ * between the nodes, is below the requested bound. Outside of the tabulated range the function itself is evaluated.
+*/
+class LookupTable
+{
+    public:
+        enum Interpolation {
+            kLinear = 0,
+            kCubic = 1
+        };
+
+        LookupTable() = default;
+        ~LookupTable() = default;
+
+        bool build(std::function<float(float)> function, const float xMin, const float xMax, const float maxRelativeError,
+                   const Interpolation interpolation = kCubic, const int maxPoints = 1 << 16);
+        float computeMaxRelativeError(const int nSamplesPerInterval = 8) const;
+
+        inline float operator() (const float x) const { return evaluate(x); }
+        inline float evaluate(const float x) const;
+
+        inline bool isBuilt() const { return !fValues.empty(); }
+        inline int getNPoints() const { return fValues.empty() ? 0 : fValues.size() - 2; }
+        inline float getMaxRelativeError() const { return fMaxRelativeError; }
+
+    private:
+        void fill(const int nPoints);
+
+        std::function<float(float)> fFunction;
+        Interpolation fInterpolation = kCubic;
+        float fXMin = 0.;
+        float fXMax = 0.;
+        float fInverseStep = 0.;
+        float fMaxRelativeError = 0.;       // measured when the table is built
+        std::vector<float> fValues;
+};
+
+/**
+ * Start from 64 nodes and double them until the bound is reached.
+ * @return false if the bound is not reached with maxPoints nodes (the finest table is kept)
+*/
+bool LookupTable::build(std::function<float(float)> function, const float xMin, const float xMax, const float maxRelativeError,
+                        const Interpolation interpolation, const int maxPoints)
+{
+    fFunction = function;
+    fInterpolation = interpolation;
+    fXMin = xMin;
+    fXMax = xMax;
+    for (int nPoints = 64; ; nPoints *= 2)
+    {
+        fill(std::min(nPoints, maxPoints));
+        fMaxRelativeError = computeMaxRelativeError();
+        if (fMaxRelativeError <= maxRelativeError)
+            return true;
+        if (nPoints >= maxPoints)
+            break;
+    }
+    std::cerr << "LookupTable: relative error " << fMaxRelativeError << " above " << maxRelativeError
+              << " with " << getNPoints() << " points" << std::endl;
+    return false;
+}
+
+/**
+ * The nodes are stored with a ghost node on each side, extrapolated quadratically from the edge nodes, so that the
+ * cubic interpolation needs no special case at the edges (and the function is not evaluated outside of the range)
+*/
+void LookupTable::fill(const int nPoints)
+{
+    const double step = (static_cast<double>(fXMax) - fXMin) / (nPoints - 1);
+    fInverseStep = 1. / step;
+    fValues.resize(nPoints + 2);
+    for (int iPoint = 0; iPoint < nPoints; iPoint++)
+        fValues[iPoint + 1] = fFunction(fXMin + iPoint * step);
+    fValues[0] = 3.f * fValues[1] - 3.f * fValues[2] + fValues[3];
+    fValues[nPoints + 1] = 3.f * fValues[nPoints] - 3.f * fValues[nPoints - 1] + fValues[nPoints - 2];
+}
+
+/**
+ * Largest relative difference between the table and the function, sampled between the nodes
+*/
+float LookupTable::computeMaxRelativeError(const int nSamplesPerInterval) const
+{
+    const int nSamples = (getNPoints() - 1) * nSamplesPerInterval;
+    const float step = (fXMax - fXMin) / nSamples;
+    float maxRelativeError = 0.;
+    for (int iSample = 0; iSample < nSamples; iSample++)
+    {
+        const float x = fXMin + (iSample + 0.5f) * step;
+        const float expected = fFunction(x);
+        if (expected == 0.)
+            continue;
+        maxRelativeError = std::max(maxRelativeError, std::abs(evaluate(x) / expected - 1.f));
+    }
+    return maxRelativeError;
+}
+
+float LookupTable::evaluate(const float x) const
+{
+    if (!(x >= fXMin && x < fXMax) || fValues.empty())
+        return fFunction(x);
+
+    const float u = (x - fXMin) * fInverseStep;
+    const int i = std::min(static_cast<int>(u), getNPoints() - 2);
+    const float t = u - i;
+    const float * y = fValues.data() + i;   // y[1] is the node at the left of x
+    const float y0 = y[0], y1 = y[1], y2 = y[2], y3 = y[3];
+    if (fInterpolation == kLinear)
+        return y1 + t * (y2 - y1);
+    return y1 + 0.5f * t * (y2 - y0 + t * (2.f * y0 - 5.f * y1 + 4.f * y2 - y3 + t * (3.f * (y1 - y2) + y3 - y0)));
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <Riostream.h>
+#include <TDirectory.h>
+#include <TH1D.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+/**
+ * Memory footprint of the data structures of a run (bytes allocated by their vectors, i.e. capacity, not size) and of
+ * the process (peak resident set size).
+*/
+namespace memoryAccounting {
+
+    const double kMegaByte = 1024. * 1024.;
+
+    template <typename T>
+    size_t vectorBytes(const std::vector<T>& values) { return values.capacity() * sizeof(T); }
+
+    template <typename T>
+    size_t vectorBytes(const std::vector<std::vector<T>>& values)
+    {
+        size_t bytes = values.capacity() * sizeof(std::vector<T>);
+        for (const std::vector<T>& inner : values)
+            bytes += vectorBytes(inner);
+        return bytes;
+    }
+
+    /**
+     * Peak resident set size of the process, 0 if not available
+    */
+    size_t getPeakRSSBytes()
+    {
+#ifdef __linux__
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return static_cast<size_t>(usage.ru_maxrss) * 1024;     // kB on Linux
+#endif
+        return 0;
+    }
+
+}   // namespace memoryAccounting
+
+/**
+ * Bytes used by named data structures, reported with the peak resident set size of the process and, if set, the
+ * memory budget of the run
+*/
+class MemoryReport
+{
+    public:
+        MemoryReport() = default;
+        ~MemoryReport() = default;
+
+        /**
+         * Set (or replace) the bytes of a data structure
+        */
+        void set(const std::string& name, const size_t bytes);
+        inline void setBudget(const size_t budgetBytes) { fBudgetBytes = budgetBytes; }
+        size_t getTotal() const;
+        size_t getBytes(const std::string& name) const;
+        /**
+         * @return false if a budget is set and the peak resident set size exceeded it
+        */
+        bool isWithinBudget() const;
+
+        void printSummary() const;
+        void saveSummary(TDirectory * output) const;
+
+    private:
+        std::vector<std::pair<std::string, size_t>> fEntries;
+        size_t fBudgetBytes = 0;            // 0: no budget
+};
+
+void MemoryReport::set(const std::string& name, const size_t bytes)
+{
+    for (auto& entry : fEntries)
+    {
+        if (entry.first == name)
+        {
+            entry.second = bytes;
+            return;
+        }
+    }
+    fEntries.emplace_back(name, bytes);
+}
+
+size_t MemoryReport::getTotal() const
+{
+    size_t total = 0;
+    for (const auto& entry : fEntries)
+        total += entry.second;
+    return total;
+}
+
+size_t MemoryReport::getBytes(const std::string& name) const
+{
+    for (const auto& entry : fEntries)
+        if (entry.first == name)
+            return entry.second;
+    return 0;
+}
+
+bool MemoryReport::isWithinBudget() const
+{
+    return fBudgetBytes == 0 || memoryAccounting::getPeakRSSBytes() <= fBudgetBytes;
+}
+
+void MemoryReport::printSummary() const
+{
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Memory summary" << std::endl;
+    for (const auto& entry : fEntries)
+        std::cout << "  " << entry.first << ": " << entry.second / memoryAccounting::kMegaByte << " MB" << std::endl;
+    std::cout << "  total: " << getTotal() / memoryAccounting::kMegaByte << " MB" << std::endl;
+    std::cout << "  peak resident set size: " << memoryAccounting::getPeakRSSBytes() / memoryAccounting::kMegaByte << " MB" << std::endl;
+    if (fBudgetBytes > 0)
+        std::cout << "  budget: " << fBudgetBytes / memoryAccounting::kMegaByte << " MB" << std::endl;
+    std::cout << "--------------------------------" << std::endl;
+    if (!isWithinBudget())
+        std::cerr << "The peak resident set size (" << memoryAccounting::getPeakRSSBytes() / memoryAccounting::kMegaByte
+                  << " MB) exceeded the memory budget (" << fBudgetBytes / memoryAccounting::kMegaByte
+                  << " MB), the projection underestimated this run: lower memoryBudget or split the input in shards." << std::endl;
+}
+
+/**
+ * Store the figures (MB) as a labelled histogram: the data structures, then the peak resident set size and the budget
+*/
+void MemoryReport::saveSummary(TDirectory * output) const
+{
+    output->cd();
+    const int nEntries = fEntries.size();
+    TH1D hMemory("hMemory", "; ; Memory (MB)", nEntries + 2, 0, nEntries + 2);
+    for (int iEntry = 0; iEntry < nEntries; iEntry++)
+    {
+        hMemory.GetXaxis()->SetBinLabel(iEntry + 1, fEntries[iEntry].first.c_str());
+        hMemory.SetBinContent(iEntry + 1, fEntries[iEntry].second / memoryAccounting::kMegaByte);
+    }
+    hMemory.GetXaxis()->SetBinLabel(nEntries + 1, "peak resident set size");
+    hMemory.SetBinContent(nEntries + 1, memoryAccounting::getPeakRSSBytes() / memoryAccounting::kMegaByte);
+    hMemory.GetXaxis()->SetBinLabel(nEntries + 2, "budget");
+    hMemory.SetBinContent(nEntries + 2, fBudgetBytes / memoryAccounting::kMegaByte);
+    hMemory.Write();
+}
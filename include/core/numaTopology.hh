@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Riostream.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * NUMA topology of the host, read from /sys/devices/system/node (Linux), and binding of a thread to a node.
+ * Without NUMA information (other systems, containers without sysfs) the host is a single node with all the CPUs.
+ * A thread bound to a node runs on the CPUs of the node and allocates its pages there (preferred, not strict, so that
+ * an allocation still succeeds when the node is full). Threads started by a bound thread inherit the binding, so
+ * binding a process before its first thread places all its data on the node by first touch.
+*/
+namespace numaTopology {
+
+    struct Node
+    {
+        int fId;                    // sysfs node number
+        std::vector<int> fCpus;
+    };
+
+    /**
+     * Integers of a sysfs list, e.g. "0-3,8-11"
+    */
+    std::vector<int> parseList(const std::string& list)
+    {
+        std::vector<int> values;
+        std::stringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            if (range.find_first_of("0123456789") == std::string::npos)
+                continue;
+            const size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int value = first; value <= last; value++)
+                values.push_back(value);
+        }
+        return values;
+    }
+
+    std::string readFirstLine(const std::string& fileName)
+    {
+        std::ifstream file(fileName);
+        std::string line;
+        if (file)
+            std::getline(file, line);
+        return line;
+    }
+
+    /**
+     * Online nodes with CPUs (memory-only nodes are skipped), in node order
+    */
+    std::vector<Node> getNodes()
+    {
+        std::vector<Node> nodes;
+        for (const int id : parseList(readFirstLine("/sys/devices/system/node/online")))
+        {
+            const std::vector<int> cpus = parseList(readFirstLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"));
+            if (!cpus.empty())
+                nodes.push_back({id, cpus});
+        }
+        if (nodes.empty())
+        {
+            nodes.push_back({0, {}});
+            for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+                nodes.back().fCpus.push_back(cpu);
+        }
+        return nodes;
+    }
+
+    int getNNodes() { return getNodes().size(); }
+
+    /**
+     * Bind the calling thread (and the threads it starts afterwards) to the CPUs and memory of the iNode-th node of
+     * getNodes (taken modulo the number of nodes)
+     * @return false if the binding is not supported or failed
+    */
+    bool bindThreadToNode(const int iNode)
+    {
+#ifdef __linux__
+        const std::vector<Node> nodes = getNodes();
+        const Node& node = nodes[iNode % nodes.size()];
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (const int cpu : node.fCpus)
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &cpuSet);
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+        {
+            std::cerr << "numaTopology: could not bind the thread to the CPUs of node " << node.fId << std::endl;
+            return false;
+        }
+        if (nodes.size() == 1)
+            return true;
+
+        // preferred memory node of the thread: set_mempolicy(MPOL_PREFERRED), the mask size is passed as bits + 1
+        const int kMemoryPolicyPreferred = 1;
+        const int kMaxMaskNodes = 8 * sizeof(unsigned long);
+        if (node.fId >= kMaxMaskNodes)
+        {
+            std::cerr << "numaTopology: node " << node.fId << " is beyond the supported node mask" << std::endl;
+            return false;
+        }
+        const unsigned long nodeMask = 1UL << node.fId;
+        if (syscall(SYS_set_mempolicy, kMemoryPolicyPreferred, &nodeMask, kMaxMaskNodes + 1) != 0)
+        {
+            std::cerr << "numaTopology: could not set the preferred memory node " << node.fId << std::endl;
+            return false;
+        }
+        return true;
+#else
+        (void)iNode;
+        return false;
+#endif
+    }
+
+}   // namespace numaTopology
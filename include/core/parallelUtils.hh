@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace parallelUtils {
+
+    int gNThreads = 1;
+
+    /**
+     * Set the number of threads used by the parallel passes (0: hardware concurrency)
+    */
+    void setNThreads(const int nThreads)
+    {
+        gNThreads = nThreads > 0 ? nThreads : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    int getNThreads() { return gNThreads; }
+
+    /**
+     * Split [0, n) in at most nChunks contiguous chunks and call func(iChunk, begin, end) on each of them,
+     * one thread per chunk. The chunk boundaries only depend on n and nChunks.
+    */
+    template <typename Func>
+    void forEachChunk(const size_t n, const int nChunks, Func&& func)
+    {
+        const size_t chunkSize = (n + nChunks - 1) / std::max(1, nChunks);
+        if (nChunks <= 1 || n < 2 * static_cast<size_t>(nChunks))
+        {
+            func(0, size_t(0), n);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        for (int iChunk = 0; iChunk < nChunks; iChunk++)
+        {
+            const size_t begin = std::min(n, iChunk * chunkSize);
+            const size_t end = std::min(n, begin + chunkSize);
+            threads.emplace_back([&func, iChunk, begin, end]() { func(iChunk, begin, end); });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    /**
+     * Segment labelling of a sequence by parallel prefix sum.
+     * For each element i, label[i] is the number of segment starts in [1, i], where isStart(i) tells whether a new
+     * segment starts at i (i > 0). Each chunk counts its starts, the counts are scanned and each chunk then labels
+     * its elements independently.
+     * @return number of segments (0 for an empty sequence)
+    */
+    template <typename IsStart>
+    int labelSegments(const size_t n, IsStart&& isStart, std::vector<int>& labels, const int nThreads = getNThreads())
+    {
+        labels.resize(n);
+        if (n == 0)
+            return 0;
+
+        std::vector<int> chunkStarts(std::max(1, nThreads), 0);
+        forEachChunk(n, nThreads, [&](const int iChunk, const size_t begin, const size_t end) {
+            int nStarts = 0;
+            for (size_t i = std::max<size_t>(begin, 1); i < end; i++)
+                nStarts += isStart(i);
+            chunkStarts[iChunk] = nStarts;
+        });
+
+        std::vector<int> chunkOffsets(chunkStarts.size(), 0);
+        for (size_t iChunk = 1; iChunk < chunkStarts.size(); iChunk++)
+            chunkOffsets[iChunk] = chunkOffsets[iChunk - 1] + chunkStarts[iChunk - 1];
+
+        forEachChunk(n, nThreads, [&](const int iChunk, const size_t begin, const size_t end) {
+            int label = chunkOffsets[iChunk];
+            for (size_t i = begin; i < end; i++)
+            {
+                if (i > 0 && isStart(i))
+                    label++;
+                labels[i] = label;
+            }
+        });
+
+        return labels.back() + 1;
+    }
+
+}   // namespace parallelUtils
@@ -46,6 +46,65 @@ namespace physics {
         return sqrt((px1 + px2) * (px1 + px2) + (py1 + py2) * (py1 + py2) + (pz1 + pz2) * (pz1 + pz2));
     }
 
+    /**
+     * Relative momentum of two particles in their rest frame, k* = |p1*| = |p2*|, from the invariant mass squared s
+     * of the pair: k*^2 = (s - (m1 + m2)^2) (s - (m1 - m2)^2) / (4 s). Closed form of the boost to the pair rest
+     * frame, evaluated in double precision because of the cancellation close to threshold.
+    */
+    inline double kstarFromInvariantMassSquared(const double s, const double m1, const double m2) {
+        const double kstarSquared = (s - (m1 + m2) * (m1 + m2)) * (s - (m1 - m2) * (m1 - m2)) / (4. * s);
+        return std::sqrt(std::abs(kstarSquared));     // negative only by rounding at threshold
+    }
+
+    /**
+     * k* of two particles given their (pt, eta, phi) and masses, through the invariant mass of the pair
+    */
+    inline double kstar(const double pt1, const double eta1, const double phi1, const double m1,
+                        const double pt2, const double eta2, const double phi2, const double m2) {
+        const double px = pt1 * std::cos(phi1) + pt2 * std::cos(phi2);
+        const double py = pt1 * std::sin(phi1) + pt2 * std::sin(phi2);
+        const double pz = pt1 * std::sinh(eta1) + pt2 * std::sinh(eta2);
+        const double e = std::sqrt(pt1 * pt1 * std::cosh(eta1) * std::cosh(eta1) + m1 * m1) +
+                         std::sqrt(pt2 * pt2 * std::cosh(eta2) * std::cosh(eta2) + m2 * m2);
+        return kstarFromInvariantMassSquared(e * e - px * px - py * py - pz * pz, m1, m2);
+    }
+
+    /**
+     * Azimuthal angle difference in [-pi, pi), for angles in the same 2pi-wide interval (e.g. [0, 2pi)).
+     * The number of turns is obtained by truncating a positive value instead of comparing, so that loops over
+     * pairs vectorise.
+    */
+    inline float deltaPhi(const float phi1, const float phi2) {
+        const float kPi = M_PI;
+        const float difference = phi1 - phi2;
+        const int nTurns = static_cast<int>((difference + 3.f * kPi) / (2.f * kPi)) - 1;
+        return difference - 2.f * kPi * nTurns;
+    }
+
+    /**
+     * Rapidity of a particle given its transverse momentum, pseudorapidity and mass
+    */
+    inline float rapidity(const float pt, const float eta, const float mass) {
+        return std::asinh(pt * std::sinh(eta) / std::sqrt(pt * pt + mass * mass));
+    }
+
+    /**
+     * Largest difference of the longitudinal rapidities of two particles whose pair has k* below kstarMax.
+     * k* grows with the Lorentz factor of the relative motion of the two particles, gamma = (s - m1^2 - m2^2) / (2 m1 m2),
+     * and gamma >= cosh(y1 - y2).
+    */
+    inline double maxRapidityDifference(const double kstarMax, const double m1, const double m2) {
+        const double sqrtS = std::sqrt(m1 * m1 + kstarMax * kstarMax) + std::sqrt(m2 * m2 + kstarMax * kstarMax);
+        return std::acosh((sqrtS * sqrtS - m1 * m1 - m2 * m2) / (2. * m1 * m2));
+    }
+
+    /**
+     * Azimuthal angle phi rotated by angle, brought back to [-pi, pi]
+    */
+    inline float rotateAngle(const float phi, const float angle) {
+        return std::remainder(phi + angle, 2 * M_PI);
+    }
+
     float randomAngleRotation(const float phi) {
         float randomAngle = gRandom->Uniform(0, 2 * M_PI);
         if (phi + randomAngle > M_PI) {
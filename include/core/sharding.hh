@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Subset of the z-vertex/centrality bins (HistVertexMultiplicity::getBinIndex) processed by a job.
+ * Mixing only pairs collisions from the same bin, so disjoint shards produce disjoint, complete sets of pairs.
+ * A shard is defined either by a hash range (shardIndex out of shardCount) or by an explicit list of bins.
+ * The default-constructed shard contains all bins.
+*/
+class BinShard
+{
+    public:
+        BinShard() = default;
+        BinShard(const int shardIndex, const int shardCount)
+            : fShardIndex(shardIndex), fShardCount(shardCount) {}
+        BinShard(const std::vector<int>& bins)
+            : fBins(bins) { std::sort(fBins.begin(), fBins.end()); }
+        ~BinShard() = default;
+
+        bool contains(const int iBin) const;
+        bool isValid(const int nBins) const;
+        bool isSharded() const { return fShardCount > 1 || !fBins.empty(); }
+        std::string getLabel() const;
+        unsigned int getSeedOffset() const;
+
+        int getShardIndex() const { return fShardIndex; }
+        int getShardCount() const { return fShardCount; }
+
+    private:
+        static unsigned int hashBin(const int iBin);
+        uint64_t hashBins() const;
+
+        int fShardIndex = 0;
+        int fShardCount = 1;
+        std::vector<int> fBins;     // explicit list of bins, takes precedence over the hash range
+};
+
+/**
+ * Integer finaliser of MurmurHash3, so that neighbouring (and similarly populated) bins end up in different shards
+*/
+unsigned int BinShard::hashBin(const int iBin)
+{
+    unsigned int hash = static_cast<unsigned int>(iBin);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+bool BinShard::contains(const int iBin) const
+{
+    if (!fBins.empty())
+        return std::binary_search(fBins.begin(), fBins.end(), iBin);
+    if (fShardCount <= 1)
+        return true;
+    return static_cast<int>(hashBin(iBin) % fShardCount) == fShardIndex;
+}
+
+/**
+ * A hash range needs 0 <= shardIndex < shardCount, an explicit list bins in [0, nBins): an invalid shard would
+ * select no bin and silently produce an empty partial output
+*/
+bool BinShard::isValid(const int nBins) const
+{
+    if (!fBins.empty())
+        return fBins.front() >= 0 && fBins.back() < nBins;
+    return fShardCount >= 1 && fShardIndex >= 0 && fShardIndex < fShardCount;
+}
+
+/**
+ * FNV-1a over the sorted bins of an explicit list, mixed by hashBin: two different lists get different hashes
+*/
+uint64_t BinShard::hashBins() const
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const int iBin : fBins)
+    {
+        hash ^= hashBin(iBin);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Names the partial outputs of the shard, so it is unique: an explicit list is labelled by its number of bins and
+ * the hash of the whole list
+*/
+std::string BinShard::getLabel() const
+{
+    if (!fBins.empty())
+    {
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(hashBins()));
+        return "bins" + std::to_string(fBins.size()) + "_" + hash;
+    }
+    return "shard" + std::to_string(fShardIndex) + "of" + std::to_string(fShardCount);
+}
+
+/**
+ * Added to the random seed of the jobs: the shard index of a hash range, the hash of an explicit list (the same
+ * identity as the label), so that no two shards mix with the same random sequence
+*/
+unsigned int BinShard::getSeedOffset() const
+{
+    if (fBins.empty())
+        return static_cast<unsigned int>(fShardIndex);
+    const uint64_t hash = hashBins();
+    return static_cast<unsigned int>(hash ^ (hash >> 32));
+}
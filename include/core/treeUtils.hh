@@ -6,6 +6,7 @@
 #include <TList.h>
 #include <TKey.h>
 #include <TDirectory.h>
+#include <vector>
 
 namespace treeUtils {
 
@@ -14,6 +15,8 @@ namespace treeUtils {
 
         TFile *inputFile = TFile::Open(inputFileName, "READ");
         TList *treeList = new TList();
+        std::vector<Long64_t> dfEntryOffsets;   // first entry of each DF in the merged tree
+        Long64_t nEntries = 0;
         TIter nextDir(inputFile->GetListOfKeys());
         TKey *key;
         while ((key = (TKey *)nextDir()))
@@ -26,6 +29,8 @@ namespace treeUtils {
                 TDirectory *dir = (TDirectory *)obj;
                 TTree *tmpTree = (TTree *)dir->Get(treeName);
                 treeList->Add(tmpTree);
+                dfEntryOffsets.push_back(nEntries);
+                nEntries += tmpTree->GetEntries();
             }
             else
             {
@@ -36,6 +41,7 @@ namespace treeUtils {
         outputFile->cd();
         TTree *tree = TTree::MergeTrees(treeList);
         tree->Write();
+        outputFile->WriteObject(&dfEntryOffsets, "DFEntryOffsets");
         inputFile->Close();
 
         std::cout << "Merged tree written to file: " << outputFile->GetName() << std::endl;
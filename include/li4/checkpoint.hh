@@ -0,0 +1,115 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <Riostream.h>
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TH1D.h>
+#include <TParameter.h>
+#include <TRandom3.h>
+#include <TTree.h>
+
+#include "histograms.hh"
+#include "mixing.hh"
+
+/**
+ * Checkpoints of a mixing job, stored in its output file: the output tree is saved up to the checkpoint (TTree::AutoSave)
+ * and a Checkpoint directory holds the next He3 to mix, the random generator, the hadron reuse counts and the QA
+ * histograms. A job resumed from a checkpoint appends to the saved tree and writes the same pairs as an uninterrupted
+ * one. The checkpoint is removed when the job completes.
+ * The QA histograms are stored as TH1D, so that the counts are restored exactly.
+*/
+namespace checkpoint {
+
+    const char * kDirectoryName = "Checkpoint";
+
+    void remove(TDirectory * outputFile)
+    {
+        outputFile->Delete((std::string(kDirectoryName) + ";*").c_str());
+    }
+
+    /**
+     * Save the output tree and the state of the mixer before nextHe3. The pending pairs must have been written.
+     * @param nHe3s Stored He3s, checked when resuming
+    */
+    void save(TFile * outputFile, TTree * outputTree, const Mixer& mixer, const size_t nextHe3, const size_t nHe3s,
+              HistogramsQA& histQA)
+    {
+        outputTree->AutoSave("SaveSelf");
+        remove(outputFile);
+        TDirectory * directory = outputFile->mkdir(kDirectoryName);
+        directory->cd();
+
+        TParameter<Long64_t> nextHe3Parameter("NextHe3", nextHe3);
+        TParameter<Long64_t> nHe3sParameter("NHe3s", nHe3s);
+        TParameter<Long64_t> nEntriesParameter("NEntries", outputTree->GetEntries());
+        nextHe3Parameter.Write();
+        nHe3sParameter.Write();
+        nEntriesParameter.Write();
+        TRandom3 random(mixer.getRandom());
+        random.Write("Random");
+        directory->WriteObject(&mixer.getHadronProcessTimes(), "HadronProcessTimes");
+
+        const auto histograms = histQA.getHistograms();
+        for (int iHist = 0; iHist < HistogramsQA::kNHistograms; iHist++)
+        {
+            const FixedBinHistogram& histogram = *histograms[iHist];
+            TH1D hist(HistogramsQA::kNames[iHist], HistogramsQA::kTitles[iHist], histogram.getNBins(),
+                      histogram.getXMin(), histogram.getXMax());
+            hist.SetDirectory(nullptr);
+            histogram.fillTH1(&hist);
+            hist.Write();
+        }
+
+        outputFile->Save();
+        outputFile->Flush();
+    }
+
+    /**
+     * Restore the mixer and the QA histograms from the checkpoint of an output file opened in UPDATE mode.
+     * @return false if there is no checkpoint or if it does not match the stored candidates or the output tree
+    */
+    bool load(TFile * outputFile, TTree * outputTree, Mixer& mixer, HistogramsQA& histQA, const size_t nHe3s,
+              const size_t nHadrons)
+    {
+        TDirectory * directory = outputFile->GetDirectory(kDirectoryName);
+        if (!directory)
+            return false;
+
+        std::unique_ptr<TParameter<Long64_t>> nextHe3(directory->Get<TParameter<Long64_t>>("NextHe3"));
+        std::unique_ptr<TParameter<Long64_t>> nHe3sParameter(directory->Get<TParameter<Long64_t>>("NHe3s"));
+        std::unique_ptr<TParameter<Long64_t>> nEntries(directory->Get<TParameter<Long64_t>>("NEntries"));
+        std::unique_ptr<TRandom3> random(directory->Get<TRandom3>("Random"));
+        std::vector<int> * hadronProcessTimesPtr = nullptr;
+        directory->GetObject("HadronProcessTimes", hadronProcessTimesPtr);
+        std::unique_ptr<std::vector<int>> hadronProcessTimes(hadronProcessTimesPtr);
+        if (!nextHe3 || !nHe3sParameter || !nEntries || !random || !hadronProcessTimes)
+        {
+            std::cerr << "Incomplete checkpoint in " << outputFile->GetName() << std::endl;
+            return false;
+        }
+        if (nHe3sParameter->GetVal() != static_cast<Long64_t>(nHe3s) || hadronProcessTimes->size() != nHadrons)
+        {
+            std::cerr << "The checkpoint in " << outputFile->GetName() << " was written with different candidates" << std::endl;
+            return false;
+        }
+        if (outputTree->GetEntries() != nEntries->GetVal())
+        {
+            std::cerr << "The output tree in " << outputFile->GetName() << " has " << outputTree->GetEntries()
+                      << " entries, the checkpoint " << nEntries->GetVal() << std::endl;
+            return false;
+        }
+
+        mixer.setFirstHe3(nextHe3->GetVal());
+        mixer.setRandom(*random);
+        mixer.setHadronProcessTimes(*hadronProcessTimes);
+        histQA.reset();
+        histQA.addHistograms(directory);
+        std::cout << "Resuming " << outputFile->GetName() << " from He3 " << nextHe3->GetVal() << " ("
+                  << nEntries->GetVal() << " pairs written)" << std::endl;
+        return true;
+    }
+
+}   // namespace checkpoint
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <Riostream.h>
+#include <TTree.h>
+
+#include "../core/coldStore.hh"
+#include "../core/collisionIndex.hh"
+#include "../core/columnarFile.hh"
+#include "../core/instrumentation.hh"
+#include "../core/sharding.hh"
+#include "li4candidates.hh"
+#include "mixing.hh"
+
+/**
+ * Columnar cache of the mixing input: one row per entry of the candidate/collision trees, one column per field
+ * (same names as the branches) plus the data frame index and the explicit collision index of each entry.
+ * Converted once from the ROOT trees, then mapped in memory by every mixing job.
+*/
+namespace columnarInput {
+
+    const char * kDFIndexColumn = "fDFIndex";
+    const char * kCollisionIndexColumn = "fCollisionIndex";
+
+    /**
+     * Zero-copy views of the columns of a mapped input file
+    */
+    struct InputColumns
+    {
+        ColumnView<float> fZVertex, fCentralityFT0C;
+        ColumnView<int> fDFIndex, fCollisionIndex;
+
+        ColumnView<float> fPtHe3, fEtaHe3, fPhiHe3, fDCAxyHe3, fDCAzHe3;
+        ColumnView<unsigned int> fPIDtrkHe3;
+        ColumnView<unsigned char> fNClsTPCHe3;
+        ColumnView<float> fNSigmaTPCHe3, fChi2TPCHe3;
+        ColumnView<float> fSignalTPCHe3, fInnerParamTPCHe3, fMassTOFHe3;
+        ColumnView<unsigned int> fItsClusterSizeHe3;
+        ColumnView<unsigned char> fSharedClustersHe3;
+
+        ColumnView<float> fPtHad, fEtaHad, fPhiHad, fDCAxyHad, fDCAzHad;
+        ColumnView<unsigned int> fPIDtrkHad;
+        ColumnView<float> fNSigmaTPCHad, fNSigmaTOFHad, fChi2TPCHad;
+        ColumnView<float> fSignalTPCHad, fInnerParamTPCHad, fMassTOFHad;
+        ColumnView<unsigned int> fItsClusterSizeHad;
+        ColumnView<unsigned char> fSharedClustersHad;
+
+        bool bind(const MappedColumnarFile& file);
+        void readHe3(const size_t iRow, He3Candidate& he3) const;
+        void readHad(const size_t iRow, HadCandidate& had) const;
+        void readHe3Cold(const size_t iRow, He3ColdFields& he3Cold) const;
+        void readHadCold(const size_t iRow, HadColdFields& hadCold) const;
+    };
+
+    /**
+     * @return false if a column is missing or has a different type
+    */
+    bool InputColumns::bind(const MappedColumnarFile& file)
+    {
+        fZVertex = file.column<float>("fZVertex");
+        fCentralityFT0C = file.column<float>("fCentralityFT0C");
+        fDFIndex = file.column<int>(kDFIndexColumn);
+        fCollisionIndex = file.column<int>(kCollisionIndexColumn);
+
+        fPtHe3 = file.column<float>("fPtHe3");
+        fEtaHe3 = file.column<float>("fEtaHe3");
+        fPhiHe3 = file.column<float>("fPhiHe3");
+        fDCAxyHe3 = file.column<float>("fDCAxyHe3");
+        fDCAzHe3 = file.column<float>("fDCAzHe3");
+        fPIDtrkHe3 = file.column<unsigned int>("fPIDtrkHe3");
+        fNClsTPCHe3 = file.column<unsigned char>("fNClsTPCHe3");
+        fNSigmaTPCHe3 = file.column<float>("fNSigmaTPCHe3");
+        fChi2TPCHe3 = file.column<float>("fChi2TPCHe3");
+        fSignalTPCHe3 = file.column<float>("fSignalTPCHe3");
+        fInnerParamTPCHe3 = file.column<float>("fInnerParamTPCHe3");
+        fMassTOFHe3 = file.column<float>("fMassTOFHe3");
+        fItsClusterSizeHe3 = file.column<unsigned int>("fItsClusterSizeHe3");
+        fSharedClustersHe3 = file.column<unsigned char>("fSharedClustersHe3");
+
+        fPtHad = file.column<float>("fPtHad");
+        fEtaHad = file.column<float>("fEtaHad");
+        fPhiHad = file.column<float>("fPhiHad");
+        fDCAxyHad = file.column<float>("fDCAxyHad");
+        fDCAzHad = file.column<float>("fDCAzHad");
+        fPIDtrkHad = file.column<unsigned int>("fPIDtrkHad");
+        fNSigmaTPCHad = file.column<float>("fNSigmaTPCHadPr");
+        fNSigmaTOFHad = file.column<float>("fNSigmaTOFHadPr");
+        fChi2TPCHad = file.column<float>("fChi2TPCHad");
+        fSignalTPCHad = file.column<float>("fSignalTPCHad");
+        fInnerParamTPCHad = file.column<float>("fInnerParamTPCHad");
+        fMassTOFHad = file.column<float>("fMassTOFHad");
+        fItsClusterSizeHad = file.column<unsigned int>("fItsClusterSizeHad");
+        fSharedClustersHad = file.column<unsigned char>("fSharedClustersHad");
+
+        const size_t nRows = file.getNRows();
+        for (size_t size : {fZVertex.size(), fCentralityFT0C.size(), fDFIndex.size(), fCollisionIndex.size(),
+                            fPtHe3.size(), fEtaHe3.size(), fPhiHe3.size(), fDCAxyHe3.size(), fDCAzHe3.size(),
+                            fPIDtrkHe3.size(), fNClsTPCHe3.size(), fNSigmaTPCHe3.size(), fChi2TPCHe3.size(),
+                            fSignalTPCHe3.size(), fInnerParamTPCHe3.size(), fMassTOFHe3.size(),
+                            fItsClusterSizeHe3.size(), fSharedClustersHe3.size(),
+                            fPtHad.size(), fEtaHad.size(), fPhiHad.size(), fDCAxyHad.size(), fDCAzHad.size(),
+                            fPIDtrkHad.size(), fNSigmaTPCHad.size(), fNSigmaTOFHad.size(), fChi2TPCHad.size(),
+                            fSignalTPCHad.size(), fInnerParamTPCHad.size(), fMassTOFHad.size(),
+                            fItsClusterSizeHad.size(), fSharedClustersHad.size()})
+            if (size != nRows)
+                return false;
+        return true;
+    }
+
+    void InputColumns::readHe3(const size_t iRow, He3Candidate& he3) const
+    {
+        he3.fPtHe3 = fPtHe3[iRow];
+        he3.fEtaHe3 = fEtaHe3[iRow];
+        he3.fPhiHe3 = fPhiHe3[iRow];
+        he3.fDCAxyHe3 = fDCAxyHe3[iRow];
+        he3.fDCAzHe3 = fDCAzHe3[iRow];
+        he3.fPIDtrkHe3 = fPIDtrkHe3[iRow];
+        he3.fNClsTPCHe3 = fNClsTPCHe3[iRow];
+        he3.fNSigmaTPCHe3 = fNSigmaTPCHe3[iRow];
+        he3.fChi2TPCHe3 = fChi2TPCHe3[iRow];
+        he3.fItsClusterSizeHe3 = fItsClusterSizeHe3[iRow];
+    }
+
+    void InputColumns::readHad(const size_t iRow, HadCandidate& had) const
+    {
+        had.fPtHad = fPtHad[iRow];
+        had.fEtaHad = fEtaHad[iRow];
+        had.fPhiHad = fPhiHad[iRow];
+        had.fDCAxyHad = fDCAxyHad[iRow];
+        had.fDCAzHad = fDCAzHad[iRow];
+        had.fPIDtrkHad = fPIDtrkHad[iRow];
+        had.fNSigmaTPCHad = fNSigmaTPCHad[iRow];
+        had.fNSigmaTOFHad = fNSigmaTOFHad[iRow];
+        had.fChi2TPCHad = fChi2TPCHad[iRow];
+        had.fItsClusterSizeHad = fItsClusterSizeHad[iRow];
+    }
+
+    void InputColumns::readHe3Cold(const size_t iRow, He3ColdFields& he3Cold) const
+    {
+        he3Cold.fSignalTPCHe3 = fSignalTPCHe3[iRow];
+        he3Cold.fInnerParamTPCHe3 = fInnerParamTPCHe3[iRow];
+        he3Cold.fMassTOFHe3 = fMassTOFHe3[iRow];
+        he3Cold.fSharedClustersHe3 = fSharedClustersHe3[iRow];
+    }
+
+    void InputColumns::readHadCold(const size_t iRow, HadColdFields& hadCold) const
+    {
+        hadCold.fSignalTPCHad = fSignalTPCHad[iRow];
+        hadCold.fInnerParamTPCHad = fInnerParamTPCHad[iRow];
+        hadCold.fMassTOFHad = fMassTOFHad[iRow];
+        hadCold.fSharedClustersHad = fSharedClustersHad[iRow];
+    }
+
+    /**
+     * Convert the candidate and collision trees (same number of entries) to a columnar file.
+     * The explicit collision index is read from collisionIndexBranch if given (-1 otherwise).
+     * The entries are converted in chunks of kChunkRows, so the memory used does not depend on the input size.
+    */
+    bool convertTrees(TTree * inputCollisionTree, TTree * inputCandidateTree, const std::string& outputFileName,
+                      const char * collisionIndexBranch = nullptr)
+    {
+        const Long64_t nEntries = inputCollisionTree->GetEntries();
+        if (inputCandidateTree->GetEntries() != nEntries)
+        {
+            std::cerr << "convertTrees: the candidate and collision trees have a different number of entries" << std::endl;
+            return false;
+        }
+
+        CollisionCandidate collCand;
+        He3Candidate he3Cand;
+        HadCandidate hadCand;
+        He3ColdFields he3Cold;
+        HadColdFields hadCold;
+        collCand.setBranchAddress(inputCollisionTree);
+        he3Cand.setBranchAddress(inputCandidateTree);
+        hadCand.setBranchAddress(inputCandidateTree);
+        he3Cold.setBranchAddress(inputCandidateTree);
+        hadCold.setBranchAddress(inputCandidateTree);
+        int explicitCollisionIndex = -1;
+        if (collisionIndexBranch)
+            inputCollisionTree->SetBranchAddress(collisionIndexBranch, &explicitCollisionIndex);
+        const std::vector<Long64_t> dfEntryOffsets = collisionIndex::readDFEntryOffsets(inputCollisionTree);
+
+        const Long64_t kChunkRows = 1 << 16;
+        const size_t chunkRows = std::min(nEntries, kChunkRows);
+        std::vector<float> zVertex(chunkRows), centralityFT0C(chunkRows);
+        std::vector<int> dfIndex(chunkRows), collisionIndices(chunkRows);
+        std::vector<float> ptHe3(chunkRows), etaHe3(chunkRows), phiHe3(chunkRows), dcaxyHe3(chunkRows), dcazHe3(chunkRows);
+        std::vector<unsigned int> pidTrkHe3(chunkRows);
+        std::vector<unsigned char> nClsTPCHe3(chunkRows);
+        std::vector<float> nSigmaTPCHe3(chunkRows), chi2TPCHe3(chunkRows);
+        std::vector<float> signalTPCHe3(chunkRows), innerParamTPCHe3(chunkRows), massTOFHe3(chunkRows);
+        std::vector<unsigned int> itsClusterSizeHe3(chunkRows);
+        std::vector<unsigned char> sharedClustersHe3(chunkRows);
+        std::vector<float> ptHad(chunkRows), etaHad(chunkRows), phiHad(chunkRows), dcaxyHad(chunkRows), dcazHad(chunkRows);
+        std::vector<unsigned int> pidTrkHad(chunkRows);
+        std::vector<float> nSigmaTPCHad(chunkRows), nSigmaTOFHad(chunkRows), chi2TPCHad(chunkRows);
+        std::vector<float> signalTPCHad(chunkRows), innerParamTPCHad(chunkRows), massTOFHad(chunkRows);
+        std::vector<unsigned int> itsClusterSizeHad(chunkRows);
+        std::vector<unsigned char> sharedClustersHad(chunkRows);
+
+        // the column list, in file order: visit(name, chunk buffer)
+        auto forEachColumn = [&](auto&& visit) {
+            visit("fZVertex", zVertex);
+            visit("fCentralityFT0C", centralityFT0C);
+            visit(kDFIndexColumn, dfIndex);
+            visit(kCollisionIndexColumn, collisionIndices);
+
+            visit("fPtHe3", ptHe3);
+            visit("fEtaHe3", etaHe3);
+            visit("fPhiHe3", phiHe3);
+            visit("fDCAxyHe3", dcaxyHe3);
+            visit("fDCAzHe3", dcazHe3);
+            visit("fPIDtrkHe3", pidTrkHe3);
+            visit("fNClsTPCHe3", nClsTPCHe3);
+            visit("fNSigmaTPCHe3", nSigmaTPCHe3);
+            visit("fChi2TPCHe3", chi2TPCHe3);
+            visit("fSignalTPCHe3", signalTPCHe3);
+            visit("fInnerParamTPCHe3", innerParamTPCHe3);
+            visit("fMassTOFHe3", massTOFHe3);
+            visit("fItsClusterSizeHe3", itsClusterSizeHe3);
+            visit("fSharedClustersHe3", sharedClustersHe3);
+
+            visit("fPtHad", ptHad);
+            visit("fEtaHad", etaHad);
+            visit("fPhiHad", phiHad);
+            visit("fDCAxyHad", dcaxyHad);
+            visit("fDCAzHad", dcazHad);
+            visit("fPIDtrkHad", pidTrkHad);
+            visit("fNSigmaTPCHadPr", nSigmaTPCHad);
+            visit("fNSigmaTOFHadPr", nSigmaTOFHad);
+            visit("fChi2TPCHad", chi2TPCHad);
+            visit("fSignalTPCHad", signalTPCHad);
+            visit("fInnerParamTPCHad", innerParamTPCHad);
+            visit("fMassTOFHad", massTOFHad);
+            visit("fItsClusterSizeHad", itsClusterSizeHad);
+            visit("fSharedClustersHad", sharedClustersHad);
+        };
+
+        ColumnarWriter writer;
+        forEachColumn([&writer](const char * name, const auto& column) {
+            writer.addColumn<typename std::decay_t<decltype(column)>::value_type>(name);
+        });
+        if (!writer.open(outputFileName, nEntries))
+            return false;
+
+        for (Long64_t firstEntry = 0; firstEntry < nEntries; firstEntry += kChunkRows)
+        {
+            const Long64_t nChunk = std::min(kChunkRows, nEntries - firstEntry);
+            for (Long64_t iRow = 0; iRow < nChunk; iRow++)
+            {
+                const Long64_t iEntry = firstEntry + iRow;
+                inputCollisionTree->GetEntry(iEntry);
+                inputCandidateTree->GetEntry(iEntry);
+
+                zVertex[iRow] = collCand.fZVertex;
+                centralityFT0C[iRow] = collCand.fCentralityFT0C;
+                dfIndex[iRow] = collisionIndex::getDFIndex(dfEntryOffsets, iEntry);
+                collisionIndices[iRow] = explicitCollisionIndex;
+
+                ptHe3[iRow] = he3Cand.fPtHe3;
+                etaHe3[iRow] = he3Cand.fEtaHe3;
+                phiHe3[iRow] = he3Cand.fPhiHe3;
+                dcaxyHe3[iRow] = he3Cand.fDCAxyHe3;
+                dcazHe3[iRow] = he3Cand.fDCAzHe3;
+                pidTrkHe3[iRow] = he3Cand.fPIDtrkHe3;
+                nClsTPCHe3[iRow] = he3Cand.fNClsTPCHe3;
+                nSigmaTPCHe3[iRow] = he3Cand.fNSigmaTPCHe3;
+                chi2TPCHe3[iRow] = he3Cand.fChi2TPCHe3;
+                signalTPCHe3[iRow] = he3Cold.fSignalTPCHe3;
+                innerParamTPCHe3[iRow] = he3Cold.fInnerParamTPCHe3;
+                massTOFHe3[iRow] = he3Cold.fMassTOFHe3;
+                itsClusterSizeHe3[iRow] = he3Cand.fItsClusterSizeHe3;
+                sharedClustersHe3[iRow] = he3Cold.fSharedClustersHe3;
+
+                ptHad[iRow] = hadCand.fPtHad;
+                etaHad[iRow] = hadCand.fEtaHad;
+                phiHad[iRow] = hadCand.fPhiHad;
+                dcaxyHad[iRow] = hadCand.fDCAxyHad;
+                dcazHad[iRow] = hadCand.fDCAzHad;
+                pidTrkHad[iRow] = hadCand.fPIDtrkHad;
+                nSigmaTPCHad[iRow] = hadCand.fNSigmaTPCHad;
+                nSigmaTOFHad[iRow] = hadCand.fNSigmaTOFHad;
+                chi2TPCHad[iRow] = hadCand.fChi2TPCHad;
+                signalTPCHad[iRow] = hadCold.fSignalTPCHad;
+                innerParamTPCHad[iRow] = hadCold.fInnerParamTPCHad;
+                massTOFHad[iRow] = hadCold.fMassTOFHad;
+                itsClusterSizeHad[iRow] = hadCand.fItsClusterSizeHad;
+                sharedClustersHad[iRow] = hadCold.fSharedClustersHad;
+            }
+
+            int iColumn = 0;
+            forEachColumn([&](const char *, const auto& column) {
+                writer.writeRows(iColumn++, firstEntry, column.data(), nChunk);
+            });
+        }
+        inputCollisionTree->ResetBranchAddresses();
+        inputCandidateTree->ResetBranchAddresses();
+
+        if (!writer.close())
+            return false;
+        std::cout << "Converted " << nEntries << " entries to " << outputFileName << std::endl;
+        return true;
+    }
+
+}   // namespace columnarInput
+
+namespace mixing
+{
+    /**
+     * Same as fillParticlesFromTree, reading a mapped columnar input file.
+     * The collision keys come directly from the columns; the candidates of the selected entries are gathered from
+     * the column views. In kDisk mode the cold fields are gathered from the mapping when a pair is written, so the
+     * file must stay open until the end of the mixing.
+    */
+    std::vector<std::vector<CollHadBracket>> fillParticlesFromColumns(const MappedColumnarFile& inputFile,
+                                                                      std::vector<HadCandidate>& hadrons, std::vector<He3Candidate>& he3s,
+                                                                      std::vector<CollisionCandidate>& collisions,
+                                                                      ColdStore<HadColdFields>& hadronsCold, ColdStore<He3ColdFields>& he3sCold,
+                                                                      HistogramsQA& histQA, Instrumentation& instrumentation,
+                                                                      const bool applyCuts = false, const bool is23 = false,
+                                                                      const BinShard& shard = BinShard()) {
+
+        // the views are shared with the cold stores, which may use them after this function returns
+        auto columns = std::make_shared<columnarInput::InputColumns>();
+        if (!columns->bind(inputFile))
+        {
+            std::cerr << "fillParticlesFromColumns: the input file does not contain all the candidate columns" << std::endl;
+            return {};
+        }
+
+        const size_t nEntries = inputFile.getNRows();
+        InputCollisions inputCollisions;
+        {
+            ScopedTimer timer(instrumentation, instrumentation::kIngestion);
+            inputCollisions.fZVertices.assign(columns->fZVertex.data(), columns->fZVertex.data() + nEntries);
+            inputCollisions.fCentralities.assign(columns->fCentralityFT0C.data(), columns->fCentralityFT0C.data() + nEntries);
+            inputCollisions.fKeys.resize(nEntries);
+            for (size_t iEntry = 0; iEntry < nEntries; iEntry++)
+                inputCollisions.fKeys[iEntry] = {collisionIndex::floatBits(columns->fZVertex[iEntry]),
+                                                 collisionIndex::floatBits(columns->fCentralityFT0C[iEntry]),
+                                                 columns->fDFIndex[iEntry], columns->fCollisionIndex[iEntry]};
+        }
+
+        const bool readsHadCold = hadronsCold.readsAtIngestion();
+        const bool readsHe3Cold = he3sCold.readsAtIngestion();
+        if (!readsHadCold)
+            hadronsCold.setSource([columns](const Long64_t iEntry, HadColdFields& hadCold) { columns->readHadCold(iEntry, hadCold); });
+        if (!readsHe3Cold)
+            he3sCold.setSource([columns](const Long64_t iEntry, He3ColdFields& he3Cold) { columns->readHe3Cold(iEntry, he3Cold); });
+
+        auto readEntry = [&](const Long64_t iEntry, He3Candidate& he3Entry, HadCandidate& hadEntry,
+                             He3ColdFields& he3ColdEntry, HadColdFields& hadColdEntry) {
+            columns->readHe3(iEntry, he3Entry);
+            columns->readHad(iEntry, hadEntry);
+            if (readsHe3Cold)
+                columns->readHe3Cold(iEntry, he3ColdEntry);
+            if (readsHadCold)
+                columns->readHadCold(iEntry, hadColdEntry);
+        };
+
+        return fillParticles(inputCollisions, readEntry, hadrons, he3s, collisions, hadronsCold, he3sCold, histQA,
+                             instrumentation, applyCuts, is23, shard, false);
+    }
+
+}   // namespace mixing
@@ -1,70 +1,139 @@
 #pragma once
 
+#include <array>
+#include <memory>
+#include <mutex>
+#include <Riostream.h>
 #include <TH1F.h>
 #include <TDirectory.h>
 #include <TCanvas.h>
 
+#include "../core/fixedBinHistogram.hh"
+
+/**
+ * QA histograms of the He3 pT and of the invariant mass, accumulated in FixedBinHistogram and converted to TH1F only
+ * by saveHistograms. Filling is not locked: a thread fills its own HistogramsQA, and the partial instances are summed
+ * with addHistograms, which is thread-safe.
+*/
 struct HistogramsQA
 {
-    TH1F* hHe3BeforeEMAll = new TH1F("hHe3BeforeEMAll", "; #it{p}_{T} (GeV/#it{c}); Entries", 200, -10, 0);
-    TH1F* hHe3BeforeEM = new TH1F("hHe3BeforeEM", "; #it{p}_{T} (GeV/#it{c}); Entries", 200, -10, 0);
-    TH1F* hHe3Unique = new TH1F("hHe3Unique", "; #it{p}_{T} (GeV/#it{c}); Entries", 200, -10, 0);
-    TH1F* hHe3AfterEM = new TH1F("hHe3AfterEM", "; #it{p}_{T} (GeV/#it{c}); Entries", 200, -10, 0);
-    TH1F* hInvMassBeforeEMUnlikeSign = new TH1F("hInvMassBeforeEMUnlikeSign", "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries", 600, 3.743, 4.343);
-    TH1F* hInvMassAfterEMUnlikeSign = new TH1F("hInvMassAfterEMUnlikeSign", "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries", 600, 3.743, 4.343);
-    TH1F* hInvMassBeforeEMLikeSign = new TH1F("hInvMassBeforeEMLikeSign", "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries", 600, 3.743, 4.343);
-    TH1F* hInvMassAfterEMLikeSign = new TH1F("hInvMassAfterEMLikeSign", "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries", 600, 3.743, 4.343);
-
-    ~HistogramsQA() {
-        delete hHe3BeforeEMAll;
-        delete hHe3BeforeEM;
-        delete hHe3Unique;
-        delete hHe3AfterEM;
-
-        delete hInvMassBeforeEMUnlikeSign;
-        delete hInvMassAfterEMUnlikeSign;
-        delete hInvMassBeforeEMLikeSign;
-        delete hInvMassAfterEMLikeSign;
+    FixedBinHistogram hHe3BeforeEMAll{200, -10, 0};
+    FixedBinHistogram hHe3BeforeEM{200, -10, 0};
+    FixedBinHistogram hHe3Unique{200, -10, 0};
+    FixedBinHistogram hHe3AfterEM{200, -10, 0};
+    FixedBinHistogram hInvMassBeforeEMUnlikeSign{600, 3.743, 4.343};
+    FixedBinHistogram hInvMassAfterEMUnlikeSign{600, 3.743, 4.343};
+    FixedBinHistogram hInvMassBeforeEMLikeSign{600, 3.743, 4.343};
+    FixedBinHistogram hInvMassAfterEMLikeSign{600, 3.743, 4.343};
+
+    static constexpr int kNHistograms = 8;
+    static constexpr const char * kNames[kNHistograms] = {"hHe3BeforeEMAll", "hHe3BeforeEM", "hHe3Unique", "hHe3AfterEM",
+                                                          "hInvMassBeforeEMUnlikeSign", "hInvMassAfterEMUnlikeSign",
+                                                          "hInvMassBeforeEMLikeSign", "hInvMassAfterEMLikeSign"};
+    static constexpr const char * kTitles[kNHistograms] = {"; #it{p}_{T} (GeV/#it{c}); Entries", "; #it{p}_{T} (GeV/#it{c}); Entries",
+                                                           "; #it{p}_{T} (GeV/#it{c}); Entries", "; #it{p}_{T} (GeV/#it{c}); Entries",
+                                                           "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries", "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries",
+                                                           "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries", "; m (p+^{3}He) (GeV/#it{c}^{2}); Entries"};
+
+    std::array<FixedBinHistogram *, kNHistograms> getHistograms()
+    {
+        return {&hHe3BeforeEMAll, &hHe3BeforeEM, &hHe3Unique, &hHe3AfterEM,
+                &hInvMassBeforeEMUnlikeSign, &hInvMassAfterEMUnlikeSign,
+                &hInvMassBeforeEMLikeSign, &hInvMassAfterEMLikeSign};
+    }
+
+    std::array<const FixedBinHistogram *, kNHistograms> getHistograms() const
+    {
+        return {&hHe3BeforeEMAll, &hHe3BeforeEM, &hHe3Unique, &hHe3AfterEM,
+                &hInvMassBeforeEMUnlikeSign, &hInvMassAfterEMUnlikeSign,
+                &hInvMassBeforeEMLikeSign, &hInvMassAfterEMLikeSign};
+    }
+
+    /**
+     * Add the histograms stored in a directory written by saveHistograms (e.g. from a partial output) or by a checkpoint
+    */
+    void addHistograms(TDirectory* input)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        const auto histograms = getHistograms();
+        for (int iHist = 0; iHist < kNHistograms; iHist++)
+        {
+            TH1* inputHist = (TH1*)input->Get(kNames[iHist]);
+            if (!inputHist) {
+                std::cerr << "Missing histogram " << kNames[iHist] << " in " << input->GetName() << std::endl;
+                continue;
+            }
+            histograms[iHist]->add(inputHist);
+        }
+    }
+
+    /**
+     * Add the histograms of another instance (e.g. the ones filled while reading the input, shared by several mixings,
+     * or the ones filled by a worker thread)
+    */
+    void addHistograms(const HistogramsQA& other)
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        const auto histograms = getHistograms();
+        const auto otherHistograms = other.getHistograms();
+        for (int iHist = 0; iHist < kNHistograms; iHist++)
+            histograms[iHist]->add(*otherHistograms[iHist]);
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(fMutex);
+        for (FixedBinHistogram* histogram : getHistograms())
+            histogram->reset();
     }
 
     void saveHistograms(TDirectory* output)
     {
+        std::lock_guard<std::mutex> lock(fMutex);
         output->cd();
 
-        hHe3BeforeEMAll->Write();
-        hHe3BeforeEM->Write();
-        hHe3Unique->Write();
-        hHe3AfterEM->Write();
-
-        hInvMassBeforeEMUnlikeSign->Write();
-        hInvMassAfterEMUnlikeSign->Write();
-        hInvMassBeforeEMLikeSign->Write();
-        hInvMassAfterEMLikeSign->Write();
+        const auto histograms = getHistograms();
+        std::array<std::unique_ptr<TH1F>, kNHistograms> outputHists;
+        for (int iHist = 0; iHist < kNHistograms; iHist++)
+        {
+            const FixedBinHistogram& histogram = *histograms[iHist];
+            outputHists[iHist].reset(new TH1F(kNames[iHist], kTitles[iHist], histogram.getNBins(), histogram.getXMin(), histogram.getXMax()));
+            outputHists[iHist]->SetDirectory(nullptr);
+            histogram.fillTH1(outputHists[iHist].get());
+            outputHists[iHist]->Write();
+        }
+        TH1F* hHe3BeforeEMAllOut = outputHists[0].get();
+        TH1F* hHe3BeforeEMOut = outputHists[1].get();
+        TH1F* hHe3AfterEMOut = outputHists[3].get();
+        TH1F* hInvMassBeforeEMUnlikeSignOut = outputHists[4].get();
+        TH1F* hInvMassAfterEMUnlikeSignOut = outputHists[5].get();
+        TH1F* hInvMassBeforeEMLikeSignOut = outputHists[6].get();
+        TH1F* hInvMassAfterEMLikeSignOut = outputHists[7].get();
 
         // plot in the same canvas
-        hHe3BeforeEMAll->SetLineColor(kBlack);
-        hHe3BeforeEM->SetLineColor(kRed);
-        hHe3AfterEM->SetLineColor(kBlue);
+        hHe3BeforeEMAllOut->SetLineColor(kBlack);
+        hHe3BeforeEMOut->SetLineColor(kRed);
+        hHe3AfterEMOut->SetLineColor(kBlue);
         TCanvas* cHe3PtComparison = new TCanvas("c_he3PtComparison", "", 800, 600);
-        hHe3BeforeEMAll->DrawNormalized();
-        hHe3BeforeEM->DrawNormalized("SAME");
-        hHe3AfterEM->DrawNormalized("SAME");
+        hHe3BeforeEMAllOut->DrawNormalized();
+        hHe3BeforeEMOut->DrawNormalized("SAME");
+        hHe3AfterEMOut->DrawNormalized("SAME");
         cHe3PtComparison->BuildLegend();
         cHe3PtComparison->Write();
 
-        hInvMassBeforeEMLikeSign->SetLineColor(kRed);
-        hInvMassAfterEMLikeSign->SetLineColor(kBlue);
+        hInvMassBeforeEMLikeSignOut->SetLineColor(kRed);
+        hInvMassAfterEMLikeSignOut->SetLineColor(kBlue);
         TCanvas* cInvariantMassComparisonLikeSign = new TCanvas("c_invariantMassComparisonLikeSign", "", 800, 600);
-        hInvMassBeforeEMLikeSign->DrawNormalized();
-        hInvMassAfterEMLikeSign->DrawNormalized("SAME");
+        hInvMassBeforeEMLikeSignOut->DrawNormalized();
+        hInvMassAfterEMLikeSignOut->DrawNormalized("SAME");
         cInvariantMassComparisonLikeSign->BuildLegend();
         cInvariantMassComparisonLikeSign->Write();
 
-        hInvMassBeforeEMUnlikeSign->SetLineColor(kRed);
-        hInvMassAfterEMUnlikeSign->SetLineColor(kBlue);
+        hInvMassBeforeEMUnlikeSignOut->SetLineColor(kRed);
+        hInvMassAfterEMUnlikeSignOut->SetLineColor(kBlue);
         TCanvas* cInvariantMassComparisonUnlikeSign = new TCanvas("c_invariantMassComparisonUnlikeSign", "", 800, 600);
-        hInvMassBeforeEMUnlikeSign->DrawNormalized();
-        hInvMassAfterEMUnlikeSign->DrawNormalized("SAME");
+        hInvMassBeforeEMUnlikeSignOut->DrawNormalized();
+        hInvMassAfterEMUnlikeSignOut->DrawNormalized("SAME");
         cInvariantMassComparisonUnlikeSign->BuildLegend();
         cInvariantMassComparisonUnlikeSign->Write();
 
@@ -72,4 +141,7 @@ struct HistogramsQA
         delete cInvariantMassComparisonLikeSign;
         delete cInvariantMassComparisonUnlikeSign;
     }
+
+    private:
+        std::mutex fMutex;      // guards the sums, not the filling
 };
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <vector>
 #include <TTree.h>
 #include "../core/candidates.hh"
+#include "../core/halfFloat.hh"
 #include "../core/physics.hh"
 #include "histograms.hh"
 
+/**
+ * Hadron fields used by the selections and the mixing (hot tier).
+ * The fields only needed when a pair is written are in HadColdFields, stored at fColdIndex of a ColdStore.
+*/
 class HadCandidate: public Candidate
 {
     public:
@@ -14,12 +20,13 @@ class HadCandidate: public Candidate
         HadCandidate(const HadCandidate& other) = default;
         HadCandidate& operator= (const HadCandidate& other) = default;
 
-        float fPtHad, fEtaHad, fPhiHad, fDCAxyHad, fDCAzHad, fSignalTPCHad, fInnerParamTPCHad, fMassTOFHad;
-        unsigned int fItsClusterSizeHad, fPIDtrkHad;
-        unsigned char fSharedClustersHad;
+        float fPtHad, fEtaHad, fPhiHad, fDCAxyHad, fDCAzHad;
+        unsigned int fPIDtrkHad;
         float fNSigmaTPCHad, fNSigmaTOFHad, fChi2TPCHad;
+        unsigned int fItsClusterSizeHad;
         float fZHad, fCentralityFT0C;
         int CollID = -1;
+        int fColdIndex = -1;
 
         void setBranchAddress(TTree * tree) override 
         {
@@ -28,21 +35,101 @@ class HadCandidate: public Candidate
             tree->SetBranchAddress("fPhiHad", &fPhiHad);
             tree->SetBranchAddress("fDCAxyHad", &fDCAxyHad);
             tree->SetBranchAddress("fDCAzHad", &fDCAzHad);
-            tree->SetBranchAddress("fSignalTPCHad", &fSignalTPCHad);
-            tree->SetBranchAddress("fInnerParamTPCHad", &fInnerParamTPCHad);
-            tree->SetBranchAddress("fMassTOFHad", &fMassTOFHad);
-            tree->SetBranchAddress("fItsClusterSizeHad", &fItsClusterSizeHad);
             tree->SetBranchAddress("fPIDtrkHad", &fPIDtrkHad);
-            tree->SetBranchAddress("fSharedClustersHad", &fSharedClustersHad);
             
             //tree->SetBranchAddress("fNSigmaTPCHad", &fNSigmaTPCHad);
             tree->SetBranchAddress("fNSigmaTPCHadPr", &fNSigmaTPCHad);
             tree->SetBranchAddress("fNSigmaTOFHadPr", &fNSigmaTOFHad);
             
             tree->SetBranchAddress("fChi2TPCHad", &fChi2TPCHad);
+            tree->SetBranchAddress("fItsClusterSizeHad", &fItsClusterSizeHad);
+        }
+
+        /**
+         * Output branches with the input names, so that a stored tree can be read back with setBranchAddress
+        */
+        void setBranch(TTree * tree)
+        {
+            tree->Branch("fPtHad", &fPtHad);
+            tree->Branch("fEtaHad", &fEtaHad);
+            tree->Branch("fPhiHad", &fPhiHad);
+            tree->Branch("fDCAxyHad", &fDCAxyHad);
+            tree->Branch("fDCAzHad", &fDCAzHad);
+            tree->Branch("fPIDtrkHad", &fPIDtrkHad);
+            
+            //tree->Branch("fNSigmaTPCHad", &fNSigmaTPCHad);
+            tree->Branch("fNSigmaTPCHadPr", &fNSigmaTPCHad);
+            tree->Branch("fNSigmaTOFHadPr", &fNSigmaTOFHad);
+            
+            tree->Branch("fChi2TPCHad", &fChi2TPCHad);
+            tree->Branch("fItsClusterSizeHad", &fItsClusterSizeHad);
+        }
+};
+
+/**
+ * Hadron fields only needed in the output (cold tier)
+*/
+class HadColdFields: public Candidate
+{
+    public:
+
+        HadColdFields() = default;
+        ~HadColdFields() = default;
+        HadColdFields(const HadColdFields& other) = default;
+        HadColdFields& operator= (const HadColdFields& other) = default;
+
+        float fSignalTPCHad, fInnerParamTPCHad, fMassTOFHad;
+        unsigned char fSharedClustersHad;
+
+        /**
+         * Half-precision copy for ColdStorage::kPacked (8 bytes instead of sizeof(*this)), see halfFloat
+        */
+        struct Packed
+        {
+            uint16_t fSignalTPCHad, fInnerParamTPCHad, fMassTOFHad;
+            unsigned char fSharedClustersHad;
+        };
+
+        Packed pack() const
+        {
+            return {halfFloat::fromFloat(fSignalTPCHad), halfFloat::fromFloat(fInnerParamTPCHad),
+                    halfFloat::fromFloat(fMassTOFHad), fSharedClustersHad};
+        }
+
+        void unpack(const Packed& packed)
+        {
+            fSignalTPCHad = halfFloat::toFloat(packed.fSignalTPCHad);
+            fInnerParamTPCHad = halfFloat::toFloat(packed.fInnerParamTPCHad);
+            fMassTOFHad = halfFloat::toFloat(packed.fMassTOFHad);
+            fSharedClustersHad = packed.fSharedClustersHad;
+        }
+
+        static std::vector<const char *> branchNames() 
+        {
+            return {"fSignalTPCHad", "fInnerParamTPCHad", "fMassTOFHad", "fSharedClustersHad"};
+        }
+
+        void setBranchAddress(TTree * tree) override 
+        {
+            tree->SetBranchAddress("fSignalTPCHad", &fSignalTPCHad);
+            tree->SetBranchAddress("fInnerParamTPCHad", &fInnerParamTPCHad);
+            tree->SetBranchAddress("fMassTOFHad", &fMassTOFHad);
+            tree->SetBranchAddress("fSharedClustersHad", &fSharedClustersHad);
+        }
+
+        void setBranch(TTree * tree)
+        {
+            tree->Branch("fSignalTPCHad", &fSignalTPCHad);
+            tree->Branch("fInnerParamTPCHad", &fInnerParamTPCHad);
+            tree->Branch("fMassTOFHad", &fMassTOFHad);
+            tree->Branch("fSharedClustersHad", &fSharedClustersHad);
         }
 };
 
+/**
+ * He3 fields used by the selections and the mixing (hot tier).
+ * The fields only needed when a pair is written are in He3ColdFields, stored at fColdIndex of a ColdStore.
+*/
 class He3Candidate: public Candidate
 {
     public:
@@ -52,12 +139,14 @@ class He3Candidate: public Candidate
         He3Candidate(const He3Candidate& other) = default;
         He3Candidate& operator= (const He3Candidate& other) = default;
 
-        float fPtHe3, fEtaHe3, fPhiHe3, fDCAxyHe3, fDCAzHe3, fSignalTPCHe3, fInnerParamTPCHe3, fMassTOFHe3;
-        unsigned int fItsClusterSizeHe3, fPIDtrkHe3;
-        unsigned char fNClsTPCHe3, fSharedClustersHe3;
+        float fPtHe3, fEtaHe3, fPhiHe3, fDCAxyHe3, fDCAzHe3;
+        unsigned int fPIDtrkHe3;
+        unsigned char fNClsTPCHe3;
         float fNSigmaTPCHe3, fChi2TPCHe3;
+        unsigned int fItsClusterSizeHe3;
         float fZHe3, fCentralityFT0C;
         int CollID = -1;
+        int fColdIndex = -1;
         
         void setBranchAddress(TTree * tree) override 
         {
@@ -66,15 +155,85 @@ class He3Candidate: public Candidate
             tree->SetBranchAddress("fPhiHe3", &fPhiHe3);
             tree->SetBranchAddress("fDCAxyHe3", &fDCAxyHe3);
             tree->SetBranchAddress("fDCAzHe3", &fDCAzHe3);
-            tree->SetBranchAddress("fSignalTPCHe3", &fSignalTPCHe3);
-            tree->SetBranchAddress("fInnerParamTPCHe3", &fInnerParamTPCHe3);
-            tree->SetBranchAddress("fMassTOFHe3", &fMassTOFHe3);
             tree->SetBranchAddress("fNClsTPCHe3", &fNClsTPCHe3);
-            tree->SetBranchAddress("fItsClusterSizeHe3", &fItsClusterSizeHe3);
             tree->SetBranchAddress("fPIDtrkHe3", &fPIDtrkHe3);
-            tree->SetBranchAddress("fSharedClustersHe3", &fSharedClustersHe3);
             tree->SetBranchAddress("fNSigmaTPCHe3", &fNSigmaTPCHe3);
             tree->SetBranchAddress("fChi2TPCHe3", &fChi2TPCHe3);
+            tree->SetBranchAddress("fItsClusterSizeHe3", &fItsClusterSizeHe3);
+        }
+
+        void setBranch(TTree * tree)
+        {
+            tree->Branch("fPtHe3", &fPtHe3);
+            tree->Branch("fEtaHe3", &fEtaHe3);
+            tree->Branch("fPhiHe3", &fPhiHe3);
+            tree->Branch("fDCAxyHe3", &fDCAxyHe3);
+            tree->Branch("fDCAzHe3", &fDCAzHe3);
+            tree->Branch("fNClsTPCHe3", &fNClsTPCHe3);
+            tree->Branch("fPIDtrkHe3", &fPIDtrkHe3);
+            tree->Branch("fNSigmaTPCHe3", &fNSigmaTPCHe3);
+            tree->Branch("fChi2TPCHe3", &fChi2TPCHe3);
+            tree->Branch("fItsClusterSizeHe3", &fItsClusterSizeHe3);
+        }
+};
+
+/**
+ * He3 fields only needed in the output (cold tier)
+*/
+class He3ColdFields: public Candidate
+{
+    public:
+
+        He3ColdFields() = default;
+        ~He3ColdFields() = default;
+        He3ColdFields(const He3ColdFields& other) = default;
+        He3ColdFields& operator= (const He3ColdFields& other) = default;
+
+        float fSignalTPCHe3, fInnerParamTPCHe3, fMassTOFHe3;
+        unsigned char fSharedClustersHe3;
+
+        /**
+         * Half-precision copy for ColdStorage::kPacked (8 bytes instead of sizeof(*this)), see halfFloat
+        */
+        struct Packed
+        {
+            uint16_t fSignalTPCHe3, fInnerParamTPCHe3, fMassTOFHe3;
+            unsigned char fSharedClustersHe3;
+        };
+
+        Packed pack() const
+        {
+            return {halfFloat::fromFloat(fSignalTPCHe3), halfFloat::fromFloat(fInnerParamTPCHe3),
+                    halfFloat::fromFloat(fMassTOFHe3), fSharedClustersHe3};
+        }
+
+        void unpack(const Packed& packed)
+        {
+            fSignalTPCHe3 = halfFloat::toFloat(packed.fSignalTPCHe3);
+            fInnerParamTPCHe3 = halfFloat::toFloat(packed.fInnerParamTPCHe3);
+            fMassTOFHe3 = halfFloat::toFloat(packed.fMassTOFHe3);
+            fSharedClustersHe3 = packed.fSharedClustersHe3;
+        }
+
+        static std::vector<const char *> branchNames() 
+        {
+            return {"fSignalTPCHe3", "fInnerParamTPCHe3", "fMassTOFHe3", "fSharedClustersHe3"};
+        }
+
+        void setBranchAddress(TTree * tree) override 
+        {
+            tree->SetBranchAddress("fSignalTPCHe3", &fSignalTPCHe3);
+            tree->SetBranchAddress("fInnerParamTPCHe3", &fInnerParamTPCHe3);
+            tree->SetBranchAddress("fMassTOFHe3", &fMassTOFHe3);
+            tree->SetBranchAddress("fSharedClustersHe3", &fSharedClustersHe3);
+        }
+
+        void setBranch(TTree * tree)
+        {
+            tree->Branch("fSignalTPCHe3", &fSignalTPCHe3);
+            tree->Branch("fInnerParamTPCHe3", &fInnerParamTPCHe3);
+            tree->Branch("fMassTOFHe3", &fMassTOFHe3);
+            tree->Branch("fSharedClustersHe3", &fSharedClustersHe3);
         }
 };
 
@@ -98,6 +257,18 @@ class CollisionCandidate: public Candidate
 
 };
 
+/**
+ * Pair variables computed by the mixing: relative momentum in the pair rest frame, transverse mass of the pair and
+ * He3 - hadron azimuthal and pseudorapidity differences
+*/
+struct PairKinematics
+{
+    float fKstar = 0.;
+    float fMt = 0.;
+    float fDeltaPhi = 0.;
+    float fDeltaEta = 0.;
+};
+
 class Li4Candidate 
 {
     public:
@@ -109,10 +280,13 @@ class Li4Candidate
 
         inline void setHe3(const He3Candidate& he3);
         inline void setHad(const HadCandidate& had);
+        inline void setHe3Cold(const He3ColdFields& he3Cold) { fHe3Cold = he3Cold; }
+        inline void setHadCold(const HadColdFields& hadCold) { fHadCold = hadCold; }
         inline void setColl(const CollisionCandidate& coll) { fColl = coll; }
         inline void setZVertex(const float z) { fColl.fZVertex = z; }
         inline void setCentralityFT0C(const float cent) { fColl.fCentralityFT0C = cent; }
         inline void setIs23(const bool is23) {  fColl.fIs23 = is23; }
+        inline void setPairKinematics(const PairKinematics& pairKinematics) { fPairKinematics = pairKinematics; }
         
         void setBranch(TTree* tree);
         float calcInvMass() const;
@@ -128,7 +302,10 @@ class Li4Candidate
 
         He3Candidate fHe3;
         HadCandidate fHad;
+        He3ColdFields fHe3Cold;
+        HadColdFields fHadCold;
         CollisionCandidate fColl;
+        PairKinematics fPairKinematics;
         bool fIsUnlikeSign = false;
         bool fIsHadSet = false;
         bool fIsHe3Set = false;
@@ -164,41 +341,56 @@ void Li4Candidate::setHad(const HadCandidate& had)
     fIsHadSet = true;
 }
 
+/**
+ * Output branches of the pairs. The branches already in the tree (output of a resumed job) are bound to the members
+ * instead of being created again.
+*/
 void Li4Candidate::setBranch(TTree* tree)
 {
-    tree->Branch("fPtHe3", &fHe3.fPtHe3);
-    tree->Branch("fEtaHe3", &fHe3.fEtaHe3);
-    tree->Branch("fPhiHe3", &fHe3.fPhiHe3);
-    tree->Branch("fPtHad", &fHad.fPtHad);
-    tree->Branch("fEtaHad", &fHad.fEtaHad);
-    tree->Branch("fPhiHad", &fHad.fPhiHad);
-    tree->Branch("fDCAxyHe3", &fHe3.fDCAxyHe3);
-    tree->Branch("fDCAzHe3", &fHe3.fDCAzHe3);
-    tree->Branch("fDCAxyHad", &fHad.fDCAxyHad);
-    tree->Branch("fDCAzHad", &fHad.fDCAzHad);
-    tree->Branch("fSignalTPCHe3", &fHe3.fSignalTPCHe3);
-    tree->Branch("fInnerParamTPCHe3", &fHe3.fInnerParamTPCHe3);
-    tree->Branch("fSignalTPCHad", &fHad.fSignalTPCHad);
-    tree->Branch("fInnerParamTPCHad", &fHad.fInnerParamTPCHad);
-    tree->Branch("fMassTOFHe3", &fHe3.fMassTOFHe3);
-    tree->Branch("fMassTOFHad", &fHad.fMassTOFHad);
-    tree->Branch("fItsClusterSizeHe3", &fHe3.fItsClusterSizeHe3);
-    tree->Branch("fItsClusterSizeHad", &fHad.fItsClusterSizeHad);
-    tree->Branch("fPIDtrkHe3", &fHe3.fPIDtrkHe3);
-    tree->Branch("fPIDtrkHad", &fHad.fPIDtrkHad);
-    tree->Branch("fSharedClustersHe3", &fHe3.fSharedClustersHe3);
-    tree->Branch("fSharedClustersHad", &fHad.fSharedClustersHad);
-    tree->Branch("fNSigmaTPCHe3", &fHe3.fNSigmaTPCHe3);
+    auto branch = [tree](const char * name, auto * address) {
+        if (tree->GetBranch(name))
+            tree->SetBranchAddress(name, address);
+        else
+            tree->Branch(name, address);
+    };
+
+    branch("fPtHe3", &fHe3.fPtHe3);
+    branch("fEtaHe3", &fHe3.fEtaHe3);
+    branch("fPhiHe3", &fHe3.fPhiHe3);
+    branch("fPtHad", &fHad.fPtHad);
+    branch("fEtaHad", &fHad.fEtaHad);
+    branch("fPhiHad", &fHad.fPhiHad);
+    branch("fDCAxyHe3", &fHe3.fDCAxyHe3);
+    branch("fDCAzHe3", &fHe3.fDCAzHe3);
+    branch("fDCAxyHad", &fHad.fDCAxyHad);
+    branch("fDCAzHad", &fHad.fDCAzHad);
+    branch("fSignalTPCHe3", &fHe3Cold.fSignalTPCHe3);
+    branch("fInnerParamTPCHe3", &fHe3Cold.fInnerParamTPCHe3);
+    branch("fSignalTPCHad", &fHadCold.fSignalTPCHad);
+    branch("fInnerParamTPCHad", &fHadCold.fInnerParamTPCHad);
+    branch("fMassTOFHe3", &fHe3Cold.fMassTOFHe3);
+    branch("fMassTOFHad", &fHadCold.fMassTOFHad);
+    branch("fItsClusterSizeHe3", &fHe3.fItsClusterSizeHe3);
+    branch("fItsClusterSizeHad", &fHad.fItsClusterSizeHad);
+    branch("fPIDtrkHe3", &fHe3.fPIDtrkHe3);
+    branch("fPIDtrkHad", &fHad.fPIDtrkHad);
+    branch("fSharedClustersHe3", &fHe3Cold.fSharedClustersHe3);
+    branch("fSharedClustersHad", &fHadCold.fSharedClustersHad);
+    branch("fNSigmaTPCHe3", &fHe3.fNSigmaTPCHe3);
     
     //tree->Branch("fNSigmaTPCHad", &fHad.fNSigmaTPCHad);
-    tree->Branch("fNSigmaTPCHadPr", &fHad.fNSigmaTPCHad);
-    tree->Branch("fNSigmaTOFHadPr", &fHad.fNSigmaTOFHad);
-
-    tree->Branch("fChi2TPCHe3", &fHe3.fChi2TPCHe3);
-    tree->Branch("fChi2TPCHad", &fHad.fChi2TPCHad);
-    tree->Branch("fZVertex", &fColl.fZVertex);
-    tree->Branch("fCentralityFT0C", &fColl.fCentralityFT0C);
-    tree->Branch("fIs23", &fColl.fIs23);
+    branch("fNSigmaTPCHadPr", &fHad.fNSigmaTPCHad);
+    branch("fNSigmaTOFHadPr", &fHad.fNSigmaTOFHad);
+
+    branch("fChi2TPCHe3", &fHe3.fChi2TPCHe3);
+    branch("fChi2TPCHad", &fHad.fChi2TPCHad);
+    branch("fZVertex", &fColl.fZVertex);
+    branch("fCentralityFT0C", &fColl.fCentralityFT0C);
+    branch("fIs23", &fColl.fIs23);
+    branch("fKstar", &fPairKinematics.fKstar);
+    branch("fMt", &fPairKinematics.fMt);
+    branch("fDeltaPhi", &fPairKinematics.fDeltaPhi);
+    branch("fDeltaEta", &fPairKinematics.fDeltaEta);
 }
 
 float Li4Candidate::li4InvMass(const He3Candidate& he3, const HadCandidate& had)
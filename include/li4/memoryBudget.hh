@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <Riostream.h>
+#include <TTree.h>
+
+#include "../core/candidates.hh"
+#include "../core/coldStore.hh"
+#include "../core/collisionIndex.hh"
+#include "../core/memoryAccounting.hh"
+#include "li4candidates.hh"
+
+/**
+ * Memory projection of a mixing run, made from the number of input entries before they are read, and the fallbacks
+ * applied when it exceeds the budget of the run.
+ * The projection is an upper bound: every entry is assumed to pass the selections and to belong to its own collision.
+ * Fallbacks, in order, until the projection fits:
+ *  - the output trees flush their baskets earlier (auto-flush size reduced from the ROOT default, kMinBasketBytes at least);
+ *  - the cold fields are not kept in memory but read back from the input when a pair is written (ColdStorage::kDisk),
+ *    which gives the same output but serialises the mixing jobs.
+ * If the projection still exceeds the budget, the run continues with a warning: the input must be split in shards.
+*/
+namespace memoryBudget {
+
+    const size_t kDefaultBasketBytes = 30000000;    // default auto-flush size of a TTree
+    const size_t kMinBasketBytes = 1 << 20;
+
+    struct Projection
+    {
+        size_t fCandidates = 0;         // hadron, He3 and collision vectors
+        size_t fColdFields = 0;
+        size_t fInputIndex = 0;         // collision keys of the entries, freed after the ingestion
+        size_t fBrackets = 0;
+        size_t fMixers = 0;             // hadron momenta and reuse counts of each job
+        size_t fOutputBaskets = 0;
+
+        size_t getTotal() const { return fCandidates + fColdFields + fInputIndex + fBrackets + fMixers + fOutputBaskets; }
+    };
+
+    size_t getColdBytesPerEntry(const ColdStorage coldStorage)
+    {
+        if (coldStorage == ColdStorage::kPacked)
+            return sizeof(HadColdFields::Packed) + sizeof(He3ColdFields::Packed);
+        if (coldStorage == ColdStorage::kDisk)
+            return 2 * sizeof(Long64_t);
+        return sizeof(HadColdFields) + sizeof(He3ColdFields);
+    }
+
+    /**
+     * @param nEntries Input entries that can be stored (e.g. scaled by the fraction of bins of a shard), including
+     * the candidates of a loaded pool
+     * @param basketBytes Auto-flush size of each output tree
+    */
+    Projection project(const size_t nEntries, const ColdStorage coldStorage, const int nJobs, const size_t basketBytes)
+    {
+        Projection projection;
+        projection.fCandidates = nEntries * (sizeof(HadCandidate) + sizeof(He3Candidate) + sizeof(CollisionCandidate));
+        projection.fColdFields = nEntries * getColdBytesPerEntry(coldStorage);
+        projection.fInputIndex = nEntries * (2 * sizeof(float) + sizeof(collisionIndex::CollisionKey) + sizeof(int));
+        projection.fBrackets = nEntries * sizeof(CollHadBracket);
+        // 4 doubles and 3 floats of hadron kinematics, the reuse count, the bracket of each He3
+        projection.fMixers = nJobs * nEntries * (4 * sizeof(double) + 3 * sizeof(float) + sizeof(int) + sizeof(void *));
+        projection.fOutputBaskets = nJobs * basketBytes;
+        return projection;
+    }
+
+    struct Plan
+    {
+        ColdStorage fColdStorage;
+        size_t fBasketBytes;
+        Projection fProjection;
+    };
+
+    /**
+     * Storage and output settings that fit the budget (see the fallbacks above)
+     * @param allowDiskColdStorage false if the cold fields cannot be read back from the input (e.g. a loaded pool)
+    */
+    Plan plan(const size_t nEntries, const ColdStorage coldStorage, const int nJobs, const size_t budgetBytes,
+              const bool allowDiskColdStorage)
+    {
+        Plan plan{coldStorage, kDefaultBasketBytes, project(nEntries, coldStorage, nJobs, kDefaultBasketBytes)};
+        std::cout << "Projected memory: " << plan.fProjection.getTotal() / memoryAccounting::kMegaByte << " MB for "
+                  << nEntries << " entries, budget " << budgetBytes / memoryAccounting::kMegaByte << " MB" << std::endl;
+        if (budgetBytes == 0 || plan.fProjection.getTotal() <= budgetBytes)
+            return plan;
+
+        // largest baskets that fit in what the other structures leave of the budget
+        auto fitBaskets = [&]() {
+            const Projection projection = project(nEntries, plan.fColdStorage, nJobs, 0);
+            const size_t withoutBaskets = projection.getTotal();
+            const size_t basketShare = withoutBaskets < budgetBytes ? (budgetBytes - withoutBaskets) / nJobs : 0;
+            plan.fBasketBytes = std::max(kMinBasketBytes, std::min(kDefaultBasketBytes, basketShare));
+            plan.fProjection = project(nEntries, plan.fColdStorage, nJobs, plan.fBasketBytes);
+        };
+
+        fitBaskets();
+        if (plan.fProjection.getTotal() > budgetBytes && allowDiskColdStorage && plan.fColdStorage != ColdStorage::kDisk)
+        {
+            plan.fColdStorage = ColdStorage::kDisk;
+            fitBaskets();
+            std::cout << "Memory budget: cold fields read back from the input (coldStorage: 1)" << std::endl;
+        }
+        if (plan.fBasketBytes < kDefaultBasketBytes)
+            std::cout << "Memory budget: output baskets flushed every " << plan.fBasketBytes / memoryAccounting::kMegaByte
+                      << " MB" << std::endl;
+        if (plan.fProjection.getTotal() <= budgetBytes)
+            return plan;
+
+        std::cerr << "The projected memory (" << plan.fProjection.getTotal() / memoryAccounting::kMegaByte
+                  << " MB) exceeds the budget, split the input in shards (shardCount)." << std::endl;
+        return plan;
+    }
+
+    /**
+     * Flush the baskets of an output tree every basketBytes bytes instead of the default
+    */
+    void applyBasketBytes(TTree * outputTree, const size_t basketBytes)
+    {
+        if (basketBytes == kDefaultBasketBytes)
+            return;
+        outputTree->SetAutoFlush(-static_cast<Long64_t>(basketBytes));
+        outputTree->SetMaxVirtualSize(basketBytes);
+    }
+
+}   // namespace memoryBudget
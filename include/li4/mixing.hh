@@ -1,12 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <thread>
 #include <vector>
 #include <Riostream.h>
+#include <TRandom3.h>
 #include <TTree.h>
 
 #include "histograms.hh"
+#include "../core/arena.hh"
+#include "../core/asyncBatchWriter.hh"
+#include "../core/binMerging.hh"
+#include "../core/boundedQueue.hh"
 #include "../core/candidates.hh"
+#include "../core/coldStore.hh"
+#include "../core/collisionIndex.hh"
 #include "../core/indexTableUtils.hh"
+#include "../core/instrumentation.hh"
+#include "../core/memoryAccounting.hh"
+#include "../core/parallelUtils.hh"
+#include "../core/sharding.hh"
 #include "li4candidates.hh"
 #include "selections.h"
 
@@ -14,10 +29,33 @@ namespace mixing
 {
     enum MixingStrategy {
         kEvent = 0,
-        kRotation = 1
+        kRotation = 1,
+        kSameEvent = 2
     };
 
-    bool preliminaryCuts(const He3Candidate& he3, const HadCandidate& had, const CollisionCandidate& collision, const bool is23) {
+    /**
+     * Charge combinations of the mixed pairs (He3 and hadron of the same or of opposite sign)
+    */
+    enum PairCharge {
+        kAllPairs = 0,
+        kLikeSign = 1,
+        kUnlikeSign = 2
+    };
+
+    /**
+     * ITS cluster-size selections (n sigma of the average cluster size times cos(lambda)), disabled by default
+    */
+    bool gApplyITSCuts = false;
+    const float kNSigmaITSHe3Min = -1.5;
+    const float kNSigmaITSHadMin = -3.;
+    void setApplyITSCuts(const bool applyITSCuts) { gApplyITSCuts = applyITSCuts; }
+
+    /**
+     * @param averageClusterSizeHe3, averageClusterSizeHad Mean ITS cluster sizes if already decoded (e.g. with
+     * ComputeAverageClusterSizes over a batch), computed here if negative. Only used with the ITS selections.
+    */
+    bool preliminaryCuts(const He3Candidate& he3, const HadCandidate& had, const CollisionCandidate& collision, const bool is23,
+                         const float averageClusterSizeHe3 = -1., const float averageClusterSizeHad = -1.) {
         
         const double pthe3 = (he3.fPIDtrkHe3 == 7) || (he3.fPIDtrkHe3 == 8) || (std::abs(he3.fPtHe3) > 2.5) ? std::abs(he3.fPtHe3) : CorrectPidTrkHe(std::abs(he3.fPtHe3));
         const double fNSigmaDCAxyHe3 = ComputeNsigmaDCAxyHe(std::abs(pthe3), he3.fDCAxyHe3);
@@ -36,77 +74,336 @@ namespace mixing
             ((he3.fChi2TPCHe3 > 0.5) || (is23 == false)) && 
             (he3.fChi2TPCHe3 < 4) &&
             (had.fChi2TPCHad < 4))
+        {
+            if (!gApplyITSCuts)
+                return true;
 
-            return true;
+            // momentum and cos(lambda) from the transverse momentum and the pseudorapidity
+            const float coshEtaHe3 = std::cosh(he3.fEtaHe3);
+            const float coshEtaHad = std::cosh(had.fEtaHad);
+            const float clusterSizeHe3 = averageClusterSizeHe3 < 0 ? ComputeAverageClusterSize(he3.fItsClusterSizeHe3) : averageClusterSizeHe3;
+            const float clusterSizeHad = averageClusterSizeHad < 0 ? ComputeAverageClusterSize(had.fItsClusterSizeHad) : averageClusterSizeHad;
+            const float fNSigmaITSHe3 = ComputeNsigmaITSHe(pthe3 * coshEtaHe3, clusterSizeHe3 / coshEtaHe3);
+            const float fNSigmaITSHad = ComputeNsigmaITSPr(std::abs(had.fPtHad) * coshEtaHad, clusterSizeHad / coshEtaHad);
+            return fNSigmaITSHe3 > kNSigmaITSHe3Min && fNSigmaITSHad > kNSigmaITSHadMin;
+        }
         
         return false;
     }
 
-    std::vector<std::vector<CollHadBracket>> fillParticlesFromTree(TTree* inputCollisionTree, TTree* inputCandidateTree, 
-                                                                   std::vector<HadCandidate>& hadrons, std::vector<He3Candidate>& he3s,
-                                                                   std::vector<CollisionCandidate>& collisions, HistogramsQA& histQA,
-                                                                   const bool applyCuts = false, const bool is23 = false) {
+    /**
+     * Rapidity of a hadron (proton mass), key of the rapidity ordering within the brackets
+    */
+    inline float hadronRapidity(const HadCandidate& hadCand)
+    {
+        return physics::rapidity(std::abs(hadCand.fPtHad), hadCand.fEtaHad, physics::mass::kProton);
+    }
+
+    /**
+     * Group the hadrons stored from hadronOffset on in brackets, one contiguous range of hadrons per collision, and
+     * add them to the bins of their collisions. The brackets must be in the same order as the collisions stored
+     * from collisionOffset on (one bracket per collision).
+     * The hadrons of each bracket are reordered by charge, negative first, then by rapidity (see hadronRapidity), and
+     * the bracket stores the index of the first positive one. hadronProcessTimes, if given, is reordered with them.
+    */
+    void appendBrackets(std::vector<HadCandidate>& hadrons, const size_t hadronOffset,
+                        const std::vector<CollisionCandidate>& collisions, const size_t collisionOffset,
+                        std::vector<std::vector<CollHadBracket>>& collisionBracket,
+                        std::vector<int> * hadronProcessTimes = nullptr)
+    {
+        HistVertexMultiplicity hVertexMultiplicity;
+        std::vector<int> bracketIndices;
+        const size_t nHadrons = hadrons.size() - hadronOffset;
+        const int nBrackets = parallelUtils::labelSegments(nHadrons, 
+            [&](const size_t i) { return hadrons[hadronOffset + i].CollID != hadrons[hadronOffset + i - 1].CollID; }, bracketIndices);
+
+        std::vector<CollHadBracket> brackets(nBrackets);
+        parallelUtils::forEachChunk(nHadrons, parallelUtils::getNThreads(), [&](const int, const size_t begin, const size_t end) {
+            for (size_t iHad = begin; iHad < end; iHad++)
+            {
+                const int iBracket = bracketIndices[iHad];
+                if (iHad == 0 || bracketIndices[iHad - 1] != iBracket)
+                {
+                    brackets[iBracket].SetMin(hadronOffset + iHad);
+                    brackets[iBracket].CollID = hadrons[hadronOffset + iHad].CollID;
+                }
+                if (iHad + 1 == nHadrons || bracketIndices[iHad + 1] != iBracket)
+                    brackets[iBracket].SetMax(hadronOffset + iHad);
+            }
+        });
+
+        // sort key of the hadrons in a bracket: charge (negative first), then rapidity
+        auto isNegative = [](const HadCandidate& hadCand) { return hadCand.fPtHad < 0.; };
+        auto sortKey = [&](const HadCandidate& hadCand) {
+            return std::make_pair(!isNegative(hadCand), hadronRapidity(hadCand));
+        };
+        parallelUtils::forEachChunk(nBrackets, parallelUtils::getNThreads(), [&](const int, const size_t begin, const size_t end) {
+            std::vector<std::pair<bool, float>> keys;
+            std::vector<int> order;
+            std::vector<HadCandidate> sortedHadrons;
+            std::vector<int> sortedProcessTimes;
+            for (size_t iBracket = begin; iBracket < end; iBracket++)
+            {
+                CollHadBracket& bracket = brackets[iBracket];
+                const int nBracketHadrons = bracket.GetMax() - bracket.GetMin() + 1;
+                const auto first = hadrons.begin() + bracket.GetMin(), last = hadrons.begin() + bracket.GetMax() + 1;
+                keys.resize(nBracketHadrons);
+                for (int iHad = 0; iHad < nBracketHadrons; iHad++)
+                    keys[iHad] = sortKey(first[iHad]);
+                if (!std::is_sorted(keys.begin(), keys.end()))
+                {
+                    order.resize(nBracketHadrons);
+                    std::iota(order.begin(), order.end(), 0);
+                    std::stable_sort(order.begin(), order.end(), [&](const int a, const int b) { return keys[a] < keys[b]; });
+                    sortedHadrons.clear();
+                    sortedProcessTimes.clear();
+                    for (const int iHad : order)
+                    {
+                        sortedHadrons.push_back(first[iHad]);
+                        if (hadronProcessTimes)
+                            sortedProcessTimes.push_back((*hadronProcessTimes)[bracket.GetMin() + iHad]);
+                    }
+                    std::copy(sortedHadrons.begin(), sortedHadrons.end(), first);
+                    if (hadronProcessTimes)
+                        std::copy(sortedProcessTimes.begin(), sortedProcessTimes.end(), hadronProcessTimes->begin() + bracket.GetMin());
+                }
+                bracket.SetSplit(std::partition_point(first, last, isNegative) - hadrons.begin());
+            }
+        });
+
+        for (int iBracket = 0; iBracket < nBrackets; iBracket++)
+        {
+            const CollisionCandidate& bracketCollision = collisions[collisionOffset + iBracket];
+            int iBin = hVertexMultiplicity.getBinIndex(bracketCollision.fZVertex, bracketCollision.fCentralityFT0C);
+            collisionBracket[iBin].push_back(brackets[iBracket]);
+        }
+    }
+
+    /**
+     * Collisions of the input entries, read in a first pass: z vertex, centrality and exact collision key of each entry
+    */
+    struct InputCollisions
+    {
+        std::vector<float> fZVertices, fCentralities;
+        std::vector<collisionIndex::CollisionKey> fKeys;
+    };
+
+    /**
+     * Selections, storage and bracket building, shared by the input formats.
+     * Collisions are identified by their exact key and indexed by a parallel prefix sum over the key boundaries, so
+     * that entries of a collision must be contiguous in the input but neighbouring collisions are never merged.
+     * He3 and collision candidates are stored once per collision, with CollID set to the collision index (continuing
+     * after the last collision already stored, so that candidates can be appended to an existing pool).
+     * readEntry(iEntry, he3, had, he3Cold, hadCold) reads the candidates of an entry, the cold fields only if the
+     * cold stores read them at ingestion. With asyncRead it is called by a separate thread, overlapping the reading
+     * with the selections; the stored candidates are identical in both modes.
+    */
+    template <typename ReadEntry>
+    std::vector<std::vector<CollHadBracket>> fillParticles(const InputCollisions& inputCollisions, ReadEntry readEntry,
+                                                           std::vector<HadCandidate>& hadrons, std::vector<He3Candidate>& he3s,
+                                                           std::vector<CollisionCandidate>& collisions,
+                                                           ColdStore<HadColdFields>& hadronsCold, ColdStore<He3ColdFields>& he3sCold,
+                                                           HistogramsQA& histQA, Instrumentation& instrumentation,
+                                                           const bool applyCuts, const bool is23, const BinShard& shard,
+                                                           const bool asyncRead) {
 
         HistVertexMultiplicity hVertexMultiplicity;
         std::vector<std::vector<CollHadBracket>> collisionBracket;
         collisionBracket.resize(hVertexMultiplicity.mZetaBins * hVertexMultiplicity.mMultBins + 1);
 
-        CollisionCandidate collCand;
-        CollisionCandidate collCandPrev;
-        CollHadBracket collBracket;
+        const std::vector<float>& zVertices = inputCollisions.fZVertices;
+        const std::vector<float>& centralities = inputCollisions.fCentralities;
+        const Long64_t nEntries = zVertices.size();
 
-        He3Candidate he3Cand;
-        HadCandidate hadCand;
+        std::vector<int> collisionIndices;
+        {
+            ScopedTimer timer(instrumentation, instrumentation::kBinning);
+            const int nCollisions = collisionIndex::buildCollisionIndex(inputCollisions.fKeys, collisionIndices);
+            std::cout << "Found " << nCollisions << " collisions in " << nEntries << " entries." << std::endl;
+        }
 
-        collCand.setBranchAddress(inputCollisionTree);
-        he3Cand.setBranchAddress(inputCandidateTree);
-        hadCand.setBranchAddress(inputCandidateTree);
+        // second pass: candidates of the selected collisions
+        CollisionCandidate collCand;
+        const size_t hadronOffset = hadrons.size();
+        const size_t collisionOffset = collisions.size();
+        const int collisionIdOffset = collisions.empty() ? 0 : collisions.back().CollID + 1;
+        int lastCollision = -1;
 
+        // collisions outside of the shard are skipped before reading the candidates
+        auto isInShard = [&](const Long64_t iEntry) {
+            return !shard.isSharded() || shard.contains(hVertexMultiplicity.getBinIndex(zVertices[iEntry], centralities[iEntry]));
+        };
 
-        for (int iEntry = 0; iEntry < inputCollisionTree->GetEntries(); iEntry++)
+        // candidates are read and selected in chunks, so that the ITS cluster sizes of a chunk are decoded at once
+        struct CandidateEntry
         {
-            inputCollisionTree->GetEntry(iEntry);
-            inputCandidateTree->GetEntry(iEntry);
+            Long64_t fEntry;
+            He3Candidate fHe3;
+            HadCandidate fHad;
+            He3ColdFields fHe3Cold;
+            HadColdFields fHadCold;
+            float fAverageClusterSizeHe3 = -1.;
+            float fAverageClusterSizeHad = -1.;
+        };
+        const size_t kChunkSize = 1024;
+
+        // selection and storage of one entry whose candidates have already been read
+        auto storeEntry = [&](CandidateEntry& candidateEntry) {
+            const Long64_t iEntry = candidateEntry.fEntry;
+            He3Candidate& he3Entry = candidateEntry.fHe3;
+            HadCandidate& hadEntry = candidateEntry.fHad;
+            collCand.fZVertex = zVertices[iEntry];
+            collCand.fCentralityFT0C = centralities[iEntry];
+            collCand.CollID = collisionIdOffset + collisionIndices[iEntry];
 
             if (applyCuts)
-                if (!preliminaryCuts(he3Cand, hadCand, collCand, is23))
-                    continue;
+            {
+                ScopedTimer timer(instrumentation, instrumentation::kCuts);
+                if (!preliminaryCuts(he3Entry, hadEntry, collCand, is23, 
+                                     candidateEntry.fAverageClusterSizeHe3, candidateEntry.fAverageClusterSizeHad))
+                {
+                    instrumentation.count(instrumentation::kEntriesRejectedCuts);
+                    return;
+                }
+            }
 
-            hadCand.fZHad = collCand.fZVertex;
-            hadCand.fCentralityFT0C = collCand.fCentralityFT0C;
-            hadrons.emplace_back(hadCand);
+            hadEntry.fZHad = collCand.fZVertex;
+            hadEntry.fCentralityFT0C = collCand.fCentralityFT0C;
+            hadEntry.CollID = collCand.CollID;
+            hadEntry.fColdIndex = hadronsCold.add(candidateEntry.fHadCold, iEntry);
+            hadrons.emplace_back(hadEntry);
 
-            if (he3Cand.fPtHe3 < 0.) {
-                if (hadCand.fPtHad < 0.) {
-                    histQA.hInvMassBeforeEMLikeSign->Fill(Li4Candidate::li4InvMass(he3Cand, hadCand));
+            if (he3Entry.fPtHe3 < 0.) {
+                if (hadEntry.fPtHad < 0.) {
+                    histQA.hInvMassBeforeEMLikeSign.fill(Li4Candidate::li4InvMass(he3Entry, hadEntry));
                 } else {
-                    histQA.hInvMassBeforeEMUnlikeSign->Fill(Li4Candidate::li4InvMass(he3Cand, hadCand));
+                    histQA.hInvMassBeforeEMUnlikeSign.fill(Li4Candidate::li4InvMass(he3Entry, hadEntry));
                 }
             }
-            histQA.hHe3BeforeEMAll->Fill(he3Cand.fPtHe3);
+            histQA.hHe3BeforeEMAll.fill(he3Entry.fPtHe3);
 
-            if (abs(collCandPrev.fZVertex - collCand.fZVertex) < 1e-5)
+            if (collCand.CollID == lastCollision)
+                return;
+
+            // a new collision has been found, dumping collision and he3 candidates
+
+            he3Entry.CollID = collCand.CollID;
+            he3Entry.fColdIndex = he3sCold.add(candidateEntry.fHe3Cold, iEntry);
+            he3s.emplace_back(he3Entry); 
+            collisions.emplace_back(collCand);
+            histQA.hHe3BeforeEM.fill(he3Entry.fPtHe3);
+            lastCollision = collCand.CollID;
+        };
+
+        // ITS cluster sizes of the whole chunk decoded in one vectorisable loop, then per-entry selection
+        std::vector<uint32_t> clusterSizeWords;
+        std::vector<float> averageClusterSizes, truncatedClusterSizes;
+        auto processChunk = [&](std::vector<CandidateEntry>& chunk) {
+            if (applyCuts && gApplyITSCuts)
             {
-                collBracket.SetMax(hadrons.size() - 1);
-                continue;
+                ScopedTimer timer(instrumentation, instrumentation::kCuts);
+                const size_t nChunk = chunk.size();
+                clusterSizeWords.resize(2 * nChunk);
+                averageClusterSizes.resize(2 * nChunk);
+                truncatedClusterSizes.resize(2 * nChunk);
+                for (size_t iCand = 0; iCand < nChunk; iCand++)
+                {
+                    clusterSizeWords[iCand] = chunk[iCand].fHe3.fItsClusterSizeHe3;
+                    clusterSizeWords[nChunk + iCand] = chunk[iCand].fHad.fItsClusterSizeHad;
+                }
+                ComputeAverageClusterSizes(clusterSizeWords.data(), 2 * nChunk, averageClusterSizes.data(), truncatedClusterSizes.data());
+                for (size_t iCand = 0; iCand < nChunk; iCand++)
+                {
+                    chunk[iCand].fAverageClusterSizeHe3 = averageClusterSizes[iCand];
+                    chunk[iCand].fAverageClusterSizeHad = averageClusterSizes[nChunk + iCand];
+                }
             }
+            for (CandidateEntry& candidateEntry : chunk)
+                storeEntry(candidateEntry);
+            chunk.clear();
+        };
 
-            if (collBracket.GetMin() != -1)
+        if (!asyncRead)
+        {
+            std::vector<CandidateEntry> chunk;
+            chunk.reserve(kChunkSize);
+            for (Long64_t iEntry = 0; iEntry < nEntries; iEntry++)
+            {
+                if (!isInShard(iEntry))
+                {
+                    instrumentation.count(instrumentation::kEntriesSkippedShard);
+                    continue;
+                }
+                chunk.emplace_back();
+                CandidateEntry& candidateEntry = chunk.back();
+                candidateEntry.fEntry = iEntry;
+                {
+                    ScopedTimer timer(instrumentation, instrumentation::kIngestion);
+                    readEntry(iEntry, candidateEntry.fHe3, candidateEntry.fHad, candidateEntry.fHe3Cold, candidateEntry.fHadCold);
+                }
+                instrumentation.count(instrumentation::kEntriesRead);
+                if (chunk.size() == kChunkSize)
+                    processChunk(chunk);
+            }
+            processChunk(chunk);
+        }
+        else
+        {
+            // reader thread: reads the candidate entries in chunks while this thread selects and stores them.
+            // kPipelineDepth chunks circulate between the two threads, the reader blocks when all of them are full.
+            const int kPipelineDepth = 4;
+            BoundedQueue<std::vector<CandidateEntry>> filledChunks(kPipelineDepth), freeChunks(kPipelineDepth);
+            for (int iChunk = 0; iChunk < kPipelineDepth; iChunk++)
             {
-                int iBin = hVertexMultiplicity.getBinIndex(collCandPrev.fZVertex, collCandPrev.fCentralityFT0C);
-                collBracket.CollID = iEntry - 1;
-                collisionBracket[iBin].push_back(collBracket);
+                std::vector<CandidateEntry> chunk;
+                chunk.reserve(kChunkSize);
+                freeChunks.push(std::move(chunk));
             }
 
-            // a new collision has been found, dumping collision and he3 candidates
+            std::thread reader([&]() {
+                std::vector<CandidateEntry> chunk;
+                if (!freeChunks.pop(chunk))
+                    return;
+                for (Long64_t iEntry = 0; iEntry < nEntries; iEntry++)
+                {
+                    if (!isInShard(iEntry))
+                    {
+                        instrumentation.count(instrumentation::kEntriesSkippedShard);
+                        continue;
+                    }
+                    chunk.emplace_back();
+                    CandidateEntry& candidateEntry = chunk.back();
+                    candidateEntry.fEntry = iEntry;
+                    {
+                        ScopedTimer timer(instrumentation, instrumentation::kIngestion);
+                        readEntry(iEntry, candidateEntry.fHe3, candidateEntry.fHad, candidateEntry.fHe3Cold, candidateEntry.fHadCold);
+                    }
+                    instrumentation.count(instrumentation::kEntriesRead);
+                    if (chunk.size() == kChunkSize)
+                    {
+                        filledChunks.push(std::move(chunk));
+                        if (!freeChunks.pop(chunk))
+                            return;
+                    }
+                }
+                if (!chunk.empty())
+                    filledChunks.push(std::move(chunk));
+                filledChunks.close();
+            });
 
-            he3s.emplace_back(he3Cand); 
-            collisions.emplace_back(collCand);
-            histQA.hHe3BeforeEM->Fill(he3Cand.fPtHe3);
+            std::vector<CandidateEntry> chunk;
+            while (filledChunks.pop(chunk))
+            {
+                processChunk(chunk);
+                freeChunks.push(std::move(chunk));
+            }
+            reader.join();
+            freeChunks.close();
+        }
 
-            collBracket.SetMin(hadrons.size() - 1);
-            collBracket.SetMax(hadrons.size() - 1);
-            collCandPrev = collCand;
+        {
+            ScopedTimer timer(instrumentation, instrumentation::kBinning);
+            appendBrackets(hadrons, hadronOffset, collisions, collisionOffset, collisionBracket);
         }
 
         std::cout << "--------------------------------" << std::endl;
@@ -119,152 +416,768 @@ namespace mixing
         return collisionBracket;
     }
 
+    /**
+     * Read the candidates from the ROOT trees, apply the selections and group the hadrons in collision brackets per
+     * z-vertex/centrality bin (see fillParticles).
+     * The collision key is the bitwise z vertex and centrality, the data frame and the explicit collision index if
+     * collisionIndexBranch is given. In kDisk mode the cold branches are not read here.
+    */
+    std::vector<std::vector<CollHadBracket>> fillParticlesFromTree(TTree* inputCollisionTree, TTree* inputCandidateTree, 
+                                                                   std::vector<HadCandidate>& hadrons, std::vector<He3Candidate>& he3s,
+                                                                   std::vector<CollisionCandidate>& collisions,
+                                                                   ColdStore<HadColdFields>& hadronsCold, ColdStore<He3ColdFields>& he3sCold,
+                                                                   HistogramsQA& histQA, Instrumentation& instrumentation,
+                                                                   const bool applyCuts = false, const bool is23 = false,
+                                                                   const BinShard& shard = BinShard(),
+                                                                   const char * collisionIndexBranch = nullptr,
+                                                                   const bool asyncRead = false) {
+
+        CollisionCandidate collCand;
+        He3Candidate he3Cand;
+        HadCandidate hadCand;
+        He3ColdFields he3Cold;
+        HadColdFields hadCold;
+
+        collCand.setBranchAddress(inputCollisionTree);
+        he3Cand.setBranchAddress(inputCandidateTree);
+        hadCand.setBranchAddress(inputCandidateTree);
+        if (hadronsCold.readsAtIngestion())
+            hadCold.setBranchAddress(inputCandidateTree);
+        else
+            hadronsCold.disableBranches(inputCandidateTree);
+        if (he3sCold.readsAtIngestion())
+            he3Cold.setBranchAddress(inputCandidateTree);
+        else
+            he3sCold.disableBranches(inputCandidateTree);
+
+        int explicitCollisionIndex = -1;
+        if (collisionIndexBranch)
+            inputCollisionTree->SetBranchAddress(collisionIndexBranch, &explicitCollisionIndex);
+
+        // first pass: collision keys, only the collision tree is read
+        const Long64_t nEntries = inputCollisionTree->GetEntries();
+        const std::vector<Long64_t> dfEntryOffsets = collisionIndex::readDFEntryOffsets(inputCollisionTree);
+        InputCollisions inputCollisions;
+        inputCollisions.fKeys.resize(nEntries);
+        inputCollisions.fZVertices.resize(nEntries);
+        inputCollisions.fCentralities.resize(nEntries);
+        {
+            ScopedTimer timer(instrumentation, instrumentation::kIngestion);
+            for (Long64_t iEntry = 0; iEntry < nEntries; iEntry++)
+            {
+                inputCollisionTree->GetEntry(iEntry);
+                inputCollisions.fZVertices[iEntry] = collCand.fZVertex;
+                inputCollisions.fCentralities[iEntry] = collCand.fCentralityFT0C;
+                inputCollisions.fKeys[iEntry] = {collisionIndex::floatBits(collCand.fZVertex), collisionIndex::floatBits(collCand.fCentralityFT0C),
+                                                 collisionIndex::getDFIndex(dfEntryOffsets, iEntry), explicitCollisionIndex};
+            }
+        }
+
+        auto readEntry = [&](const Long64_t iEntry, He3Candidate& he3Entry, HadCandidate& hadEntry,
+                             He3ColdFields& he3ColdEntry, HadColdFields& hadColdEntry) {
+            inputCandidateTree->GetEntry(iEntry);
+            he3Entry = he3Cand;
+            hadEntry = hadCand;
+            he3ColdEntry = he3Cold;
+            hadColdEntry = hadCold;
+        };
+
+        return fillParticles(inputCollisions, readEntry, hadrons, he3s, collisions, hadronsCold, he3sCold, histQA,
+                             instrumentation, applyCuts, is23, shard, asyncRead);
+    }
+
 }   // namespace mixing
 
+/**
+ * Pair accepted by the mixing, written to the output by index with its kinematics
+*/
+struct MixedPair
+{
+    int fHe3Index;
+    int fHadIndex;
+    PairKinematics fKinematics;
+};
+
+/**
+ * Kinematics of a He3 with a contiguous range of hadrons, one array per variable
+*/
+struct PairKinematicsBatch
+{
+    ArenaSpan<float> fInvMass, fKstar, fMt, fDeltaPhi, fDeltaEta;
+
+    inline PairKinematics get(const size_t i) const { return {fKstar[i], fMt[i], fDeltaPhi[i], fDeltaEta[i]}; }
+};
+
+/**
+ * Hadron ranges [first, end) of a bracket mixed with a He3: the whole bracket, a charge sub-range or, with the k*
+ * pruning, the rapidity window of each charge sub-range
+*/
+struct PartnerRanges
+{
+    int fFirst[2], fEnd[2];
+    int fNRanges = 0;
+
+    inline void add(const int first, const int end) { fFirst[fNRanges] = first; fEnd[fNRanges] = end; fNRanges++; }
+    inline int getNHadrons() const
+    {
+        int nHadrons = 0;
+        for (int iRange = 0; iRange < fNRanges; iRange++)
+            nHadrons += fEnd[iRange] - fFirst[iRange];
+        return nHadrons;
+    }
+};
+
+class PairGenerator;
+
+/**
+ * Mixing of the stored candidates. The candidates, brackets and cold stores are shared, not copied: they must outlive
+ * the Mixer and are only read, so that several Mixers (e.g. with different strategies, depths or seeds) can run
+ * concurrently on the same data, each with its own random generator, reuse counts and output.
+ * Concurrent Mixers require cold stores in kMemory or kPacked mode (in kDisk mode get() reads into a shared buffer).
+*/
 class Mixer
 {
     public:
-        Mixer() = default;
         Mixer(const std::vector<HadCandidate>& hadrons, const std::vector<He3Candidate>& he3s, 
               const std::vector<CollisionCandidate>& collisions, 
               const std::vector<std::vector<CollHadBracket>>& collisionBrackets,
+              ColdStore<HadColdFields>& hadronsCold, ColdStore<He3ColdFields>& he3sCold,
               const int mixingDepth = 5, const bool  is23 = false)
             : fHadrons(hadrons), fHe3s(he3s), fCollisions(collisions), fCollisionBrackets(collisionBrackets),
-             fMixingDepth(mixingDepth), fIs23(is23) {}
+             fHadronsCold(&hadronsCold), fHe3sCold(&he3sCold),
+             fMixingDepth(mixingDepth), fIs23(is23) { fScratchArenas.emplace_back(); }
         ~Mixer() = default;
 
-        void performEventMixing(TTree* outputTree, HistogramsQA& histQA);
-        void performAngleMixing(TTree* outputTree, HistogramsQA& histQA);
+        void performEventMixing(TTree* outputTree, HistogramsQA& histQA, Instrumentation& instrumentation);
+        void performAngleMixing(TTree* outputTree, HistogramsQA& histQA, Instrumentation& instrumentation);
+        void performSameEvent(TTree* outputTree, HistogramsQA& histQA, Instrumentation& instrumentation);
+
+        /**
+         * Write the output tree from a separate thread: the accepted pairs are handed over in batches of batchSize,
+         * nBuffers batches at most are in flight. ROOT::EnableThreadSafety() must have been called.
+        */
+        void setAsyncOutput(const bool asyncOutput, const size_t batchSize = 4096, const int nBuffers = 4)
+        {
+            fAsyncOutput = asyncOutput;
+            fOutputBatchSize = batchSize;
+            fOutputBuffers = nBuffers;
+        }
+
+        /**
+         * Incremental mixing: only the He3s from firstHe3 on are mixed, the previous ones were mixed in an earlier run.
+         * The hadrons of the earlier runs stay available as partners, with the reuse counts they reached.
+        */
+        void setFirstHe3(const size_t firstHe3) { fFirstHe3 = firstHe3; }
+        void setHadronProcessTimes(const std::vector<int>& hadronProcessTimes) { fHadronProcessTimes = hadronProcessTimes; }
+        const std::vector<int>& getHadronProcessTimes() const { return fHadronProcessTimes; }
+
+        /**
+         * Seed of the random generator of this Mixer (choice of the mixing partners)
+        */
+        void setSeed(const unsigned int seed) { fRandom.SetSeed(seed); }
+        void setRandom(const TRandom3& random) { fRandom = random; }
+        const TRandom3& getRandom() const { return fRandom; }
+
+        using CheckpointFunction = std::function<void(const size_t nextHe3)>;
+        /**
+         * Periodic checkpoints: at the start of a He3, if interval seconds have passed since the previous checkpoint,
+         * the pending pairs are written to the output tree and checkpoint(nextHe3) is called. A job resumed with
+         * setFirstHe3(nextHe3) and the random generator and reuse counts of that moment writes the same pairs.
+         * The interval is counted from the end of the previous checkpoint, so the checkpoint cost is bounded.
+        */
+        void setCheckpoint(const double interval, CheckpointFunction checkpoint)
+        {
+            fCheckpointInterval = interval;
+            fCheckpoint = checkpoint;
+        }
+
+        /**
+         * Adaptive binning: the collision brackets given to the Mixer are indexed by pool (BinMerging::mergeBrackets)
+         * and each He3 is mixed within the pool of its z-vertex/centrality bin
+        */
+        void setBinMerging(const BinMerging& binMerging) { fBinMerging = binMerging; }
+
+        /**
+         * Mix only the like-sign or the unlike-sign pairs (mixing::PairCharge): the partners of a He3 are taken from
+         * the charge sub-range of each bracket, the other hadrons are not visited
+        */
+        void setPairCharge(const int pairCharge) { fPairCharge = pairCharge; }
+
+        /**
+         * Keep only the pairs with k* below kstarMax (GeV/c, 0: no selection).
+         * With pruning, only the hadrons in the rapidity window compatible with kstarMax are visited: k* grows with the
+         * relative rapidity of the pair, which is at least the difference of the longitudinal rapidities, and the
+         * hadrons of each charge sub-range of a bracket are ordered by rapidity. Without pruning all the hadrons are
+         * tested (same pairs, used as reference).
+        */
+        void setKstarMax(const float kstarMax, const bool pruning = true)
+        {
+            fKstarMax = kstarMax;
+            fKstarPruning = pruning && kstarMax > 0;
+            // margin for the rounding of the single-precision rapidities
+            fMaxRapidityDifference = kstarMax > 0 ? physics::maxRapidityDifference(kstarMax, physics::mass::kHelium3, physics::mass::kProton) + 1.e-4 : 0.;
+        }
+
+        /**
+         * Scratch memory of a mixing worker, reset for every He3. Partner lists and pair batches are carved from it,
+         * so that the steady-state mixing loop does not allocate.
+        */
+        ScratchArena& getScratchArena(const int iWorker = 0) { return fScratchArenas[iWorker]; }
+
+        /**
+         * Memory owned by this Mixer (hadron kinematics, reuse counts, brackets of the He3s, scratch arenas), the
+         * shared candidates and brackets excluded
+        */
+        size_t getMemoryBytes() const;
 
     private:
-        std::vector<HadCandidate> fHadrons;
-        std::vector<He3Candidate> fHe3s;
-        std::vector<CollisionCandidate> fCollisions;
-        std::vector<std::vector<CollHadBracket>> fCollisionBrackets;
+        friend class PairGenerator;
+
+        void prepareMixing(const int strategy);
+        void prepareHadronMomenta();
+        void prepareOwnBrackets();
+        template <typename Emit>
+        void mixHe3(const size_t iHe3, HistogramsQA& histQA, Instrumentation& instrumentation, ScratchArena& arena, Emit&& emit);
+        template <typename Emit>
+        void pairHe3WithOwnCollision(const size_t iHe3, const int strategy, HistogramsQA& histQA,
+                                     Instrumentation& instrumentation, ScratchArena& arena, Emit&& emit);
+        void pairWithOwnCollision(TTree* outputTree, const int strategy, HistogramsQA& histQA, Instrumentation& instrumentation);
+        inline void checkpointIfDue(const size_t iHe3, AsyncBatchWriter<MixedPair>& output,
+                                    instrumentation::Clock::time_point& lastCheckpoint);
+        inline PartnerRanges getPartnerRanges(const CollHadBracket& bracket, const float ptHe3, const float rapidityHe3) const;
+        PairKinematicsBatch computePairKinematics(const He3Candidate& he3Cand, const int firstHad, const int nHad,
+                                                  ScratchArena& arena, Instrumentation& instrumentation) const;
+        AsyncBatchWriter<MixedPair>::WriteFunction makePairWriter(TTree* outputTree, const int strategy, Li4Candidate& li4Candidate,
+                                                                  Instrumentation& instrumentation);
+
+        const std::vector<HadCandidate>& fHadrons;
+        const std::vector<He3Candidate>& fHe3s;
+        const std::vector<CollisionCandidate>& fCollisions;
+        const std::vector<std::vector<CollHadBracket>>& fCollisionBrackets;
+        ColdStore<HadColdFields> * fHadronsCold = nullptr;     // cold fields, fetched only for written pairs
+        ColdStore<He3ColdFields> * fHe3sCold = nullptr;
         int fMixingDepth = 5;
         bool fIs23 = false;
+        std::vector<ScratchArena> fScratchArenas;     // one per mixing worker
+        size_t fFirstHe3 = 0;
+        std::vector<int> fHadronProcessTimes;          // times each hadron was used in event mixing, kept across calls
+        TRandom3 fRandom;
+        BinMerging fBinMerging;
+        int fPairCharge = mixing::kAllPairs;
+        float fKstarMax = 0.;
+        bool fKstarPruning = false;
+        float fMaxRapidityDifference = 0.;
+        // hadron four-momenta and angles in contiguous arrays, computed once for the pair kinematics
+        std::vector<double> fHadronPx, fHadronPy, fHadronPz, fHadronE;
+        std::vector<float> fHadronEta, fHadronPhi, fHadronRapidity;
+        std::vector<const CollHadBracket *> fOwnBrackets;     // bracket of the collision of each He3
+        std::vector<float> fRotatedPhiHe3;                    // azimuth of each He3 in the rotation mixing
+
+        bool fAsyncOutput = false;
+        size_t fOutputBatchSize = 4096;
+        int fOutputBuffers = 4;
+
+        double fCheckpointInterval = 0.;       // s
+        CheckpointFunction fCheckpoint;
 };
 
-void Mixer::performEventMixing(TTree* outputTree, HistogramsQA& histQA)
+size_t Mixer::getMemoryBytes() const
 {
-    Li4Candidate li4Candidate;
-    li4Candidate.setBranch(outputTree);
-
-    std::vector<int> hadronProcessTimes(fHadrons.size(), 0);
-    const int maxProcessTimes = 10;
+    size_t bytes = memoryAccounting::vectorBytes(fHadronProcessTimes) + memoryAccounting::vectorBytes(fOwnBrackets);
+    for (const std::vector<double> * momenta : {&fHadronPx, &fHadronPy, &fHadronPz, &fHadronE})
+        bytes += memoryAccounting::vectorBytes(*momenta);
+    for (const std::vector<float> * angles : {&fHadronEta, &fHadronPhi, &fHadronRapidity, &fRotatedPhiHe3})
+        bytes += memoryAccounting::vectorBytes(*angles);
+    for (const ScratchArena& arena : fScratchArenas)
+        bytes += arena.getCapacity();
+    return bytes;
+}
 
-    HistVertexMultiplicity hVertexMultiplicity;
-    
-    std::cout << "--------------------------------" << std::endl;
-    std::cout << "Starting event mixing with " << fHadrons.size() << " hadrons and " 
-              << fHe3s.size() << " He3 candidates." << std::endl;
+void Mixer::checkpointIfDue(const size_t iHe3, AsyncBatchWriter<MixedPair>& output,
+                            instrumentation::Clock::time_point& lastCheckpoint)
+{
+    if (!fCheckpoint || iHe3 == fFirstHe3)
+        return;
+    if (std::chrono::duration<double>(instrumentation::Clock::now() - lastCheckpoint).count() < fCheckpointInterval)
+        return;
+    output.sync();
+    fCheckpoint(iHe3);
+    lastCheckpoint = instrumentation::Clock::now();
+}
 
-    for (size_t iHe3 = 0; iHe3 < fHe3s.size(); iHe3++)
+/**
+ * Hadrons of a bracket mixed with a He3 of transverse momentum ptHe3 (signed) and rapidity rapidityHe3
+*/
+PartnerRanges Mixer::getPartnerRanges(const CollHadBracket& bracket, const float ptHe3, const float rapidityHe3) const
+{
+    PartnerRanges ranges;
+    if (fPairCharge == mixing::kAllPairs && !fKstarPruning)
     {
-        if (iHe3 % (fHe3s.size()/100) == 0) {
-            std::cout << "Processing He3 candidate " << iHe3 << " / " << fHe3s.size() << " (" 
-                      << static_cast<int>(static_cast<float>(iHe3)/fHe3s.size()*100) << "%)" << std::endl;
-        }
+        ranges.add(bracket.GetMin(), bracket.GetMax() + 1);
+        return ranges;
+    }
 
-        const He3Candidate& he3Cand = fHe3s[iHe3];
-        const CollisionCandidate& collCand = fCollisions[iHe3];
-        li4Candidate.setHe3(he3Cand);
-        int iBin = hVertexMultiplicity.getBinIndex(collCand.fZVertex, collCand.fCentralityFT0C);
-        histQA.hHe3Unique->Fill(he3Cand.fPtHe3);
+    auto addRange = [&](const int first, const int end) {
+        if (!fKstarPruning)
+        {
+            ranges.add(first, end);
+            return;
+        }
+        const float * rapidities = fHadronRapidity.data();
+        ranges.add(std::lower_bound(rapidities + first, rapidities + end, rapidityHe3 - fMaxRapidityDifference) - rapidities,
+                   std::upper_bound(rapidities + first, rapidities + end, rapidityHe3 + fMaxRapidityDifference) - rapidities);
+    };
+    const bool negativePartners = (ptHe3 < 0) == (fPairCharge == mixing::kLikeSign);
+    if (fPairCharge == mixing::kAllPairs || negativePartners)
+        addRange(bracket.GetMin(), bracket.GetSplit());
+    if (fPairCharge == mixing::kAllPairs || !negativePartners)
+        addRange(bracket.GetSplit(), bracket.GetMax() + 1);
+    return ranges;
+}
 
-        for (size_t iDepth = 0; static_cast<int>(iDepth) < fMixingDepth; iDepth++)
+/**
+ * Cartesian four-momenta and angles of the hadrons, shared by all the pairs of a hadron. Stored as separate arrays
+ * (unlike the candidates) so that the pair loop reads them with contiguous vector loads.
+*/
+void Mixer::prepareHadronMomenta()
+{
+    // rebuilt at every mixing: the hadrons are shared and may have been refilled (same size or not) since the last one
+    const size_t nHadrons = fHadrons.size();
+    fHadronPx.resize(nHadrons);
+    fHadronPy.resize(nHadrons);
+    fHadronPz.resize(nHadrons);
+    fHadronE.resize(nHadrons);
+    fHadronEta.resize(nHadrons);
+    fHadronPhi.resize(nHadrons);
+    fHadronRapidity.resize(nHadrons);
+    const double massHad = physics::mass::kProton;
+    parallelUtils::forEachChunk(nHadrons, parallelUtils::getNThreads(), [&](const int, const size_t begin, const size_t end) {
+        for (size_t iHad = begin; iHad < end; iHad++)
         {
+            const HadCandidate& hadCand = fHadrons[iHad];
+            const double ptHad = std::abs(hadCand.fPtHad);
+            fHadronPx[iHad] = ptHad * std::cos(hadCand.fPhiHad);
+            fHadronPy[iHad] = ptHad * std::sin(hadCand.fPhiHad);
+            fHadronPz[iHad] = ptHad * std::sinh(hadCand.fEtaHad);
+            fHadronE[iHad] = std::sqrt(fHadronPx[iHad] * fHadronPx[iHad] + fHadronPy[iHad] * fHadronPy[iHad] +
+                                       fHadronPz[iHad] * fHadronPz[iHad] + massHad * massHad);
+            fHadronEta[iHad] = hadCand.fEtaHad;
+            fHadronPhi[iHad] = hadCand.fPhiHad;
+            fHadronRapidity[iHad] = mixing::hadronRapidity(hadCand);
+        }
+    });
+}
 
-            if (fCollisionBrackets[iBin].size() == 0 || iDepth >= fCollisionBrackets[iBin].size())
-            {
-                break;
-            }
+/**
+ * Invariant mass, k*, mT, delta phi and delta eta of the He3 with the hadrons [firstHad, firstHad + nHad), in loops
+ * over contiguous arrays without branches (vectorised by the compiler). k* is computed in closed form from the
+ * invariant mass (physics::kstarFromInvariantMassSquared), mT = sqrt(kT^2 + ((m1 + m2) / 2)^2) with kT = |pT1 + pT2| / 2.
+*/
+PairKinematicsBatch Mixer::computePairKinematics(const He3Candidate& he3Cand, const int firstHad, const int nHad,
+                                                 ScratchArena& arena, Instrumentation& instrumentation) const
+{
+    ScopedTimer kinematicsTimer(instrumentation, instrumentation::kPairKinematics);
+    PairKinematicsBatch batch{arena.allocate<float>(nHad), arena.allocate<float>(nHad), arena.allocate<float>(nHad),
+                              arena.allocate<float>(nHad), arena.allocate<float>(nHad)};
+
+    const double massHe3 = physics::mass::kHelium3;
+    const double massHad = physics::mass::kProton;
+    const double averageMassSquared = 0.25 * (massHe3 + massHad) * (massHe3 + massHad);
+    const double ptHe3 = std::abs(he3Cand.fPtHe3);
+    const double pxHe3 = ptHe3 * std::cos(he3Cand.fPhiHe3);
+    const double pyHe3 = ptHe3 * std::sin(he3Cand.fPhiHe3);
+    const double pzHe3 = ptHe3 * std::sinh(he3Cand.fEtaHe3);
+    const double eHe3 = std::sqrt(pxHe3 * pxHe3 + pyHe3 * pyHe3 + pzHe3 * pzHe3 + massHe3 * massHe3);
+    const float etaHe3 = he3Cand.fEtaHe3;
+    const float phiHe3 = he3Cand.fPhiHe3;
 
-            int iCollEM;
-            iCollEM = gRandom->Integer(fCollisionBrackets[iBin].size());
-            int collIDHad = fCollisionBrackets[iBin][iCollEM].CollID;
-            if (collIDHad == static_cast<int>(iHe3))
+    const double * pxHad = fHadronPx.data() + firstHad;
+    const double * pyHad = fHadronPy.data() + firstHad;
+    const double * pzHad = fHadronPz.data() + firstHad;
+    const double * eHad = fHadronE.data() + firstHad;
+    const float * etaHad = fHadronEta.data() + firstHad;
+    const float * phiHad = fHadronPhi.data() + firstHad;
+    float * invMass = batch.fInvMass.data();
+    float * kstar = batch.fKstar.data();
+    float * mt = batch.fMt.data();
+    float * deltaPhi = batch.fDeltaPhi.data();
+    float * deltaEta = batch.fDeltaEta.data();
+    for (int iHad = 0; iHad < nHad; iHad++)
+    {
+        const double pxPair = pxHe3 + pxHad[iHad];
+        const double pyPair = pyHe3 + pyHad[iHad];
+        const double pzPair = pzHe3 + pzHad[iHad];
+        const double ePair = eHe3 + eHad[iHad];
+        const double invMassSquared = ePair * ePair - pxPair * pxPair - pyPair * pyPair - pzPair * pzPair;
+        invMass[iHad] = std::sqrt(invMassSquared);
+        kstar[iHad] = physics::kstarFromInvariantMassSquared(invMassSquared, massHe3, massHad);
+        mt[iHad] = std::sqrt(0.25 * (pxPair * pxPair + pyPair * pyPair) + averageMassSquared);
+    }
+    // angles in a separate single-precision loop: mixing float and double lanes in one loop prevents the vectorisation
+    for (int iHad = 0; iHad < nHad; iHad++)
+    {
+        deltaPhi[iHad] = physics::deltaPhi(phiHe3, phiHad[iHad]);
+        deltaEta[iHad] = etaHe3 - etaHad[iHad];
+    }
+    return batch;
+}
+
+/**
+ * Fills the output tree with a batch of pairs. The cold fields are fetched here, the He3 ones once per He3.
+ * Runs on the writer thread in async mode: it is the only user of li4Candidate, the output tree and the cold stores.
+ * In the rotation mixing the He3 is written with its rotated azimuth.
+*/
+AsyncBatchWriter<MixedPair>::WriteFunction Mixer::makePairWriter(TTree* outputTree, const int strategy, Li4Candidate& li4Candidate,
+                                                                 Instrumentation& instrumentation)
+{
+    return [this, outputTree, strategy, &li4Candidate, &instrumentation, lastHe3Index = -1](const std::vector<MixedPair>& pairs) mutable {
+        ScopedTimer outputTimer(instrumentation, instrumentation::kOutput);
+        for (const MixedPair& pair : pairs)
+        {
+            if (pair.fHe3Index != lastHe3Index)
             {
-                continue;
+                He3Candidate he3Cand = fHe3s[pair.fHe3Index];
+                if (strategy == mixing::kRotation)
+                    he3Cand.fPhiHe3 = fRotatedPhiHe3[pair.fHe3Index];
+                const CollisionCandidate& collCand = fCollisions[pair.fHe3Index];
+                li4Candidate.setHe3(he3Cand);
+                li4Candidate.setZVertex(collCand.fZVertex);
+                li4Candidate.setCentralityFT0C(collCand.fCentralityFT0C);
+                li4Candidate.setIs23(fIs23);
+                li4Candidate.setHe3Cold(fHe3sCold->get(he3Cand.fColdIndex));
+                lastHe3Index = pair.fHe3Index;
             }
-            for (int iHad = fCollisionBrackets[iBin][iCollEM].GetMin(); iHad <= fCollisionBrackets[iBin][iCollEM].GetMax(); iHad++)
+            const HadCandidate& hadCand = fHadrons[pair.fHadIndex];
+            li4Candidate.setHad(hadCand);
+            li4Candidate.setPairKinematics(pair.fKinematics);
+            li4Candidate.setHadCold(fHadronsCold->get(hadCand.fColdIndex));
+            outputTree->Fill();
+        }
+    };
+}
+
+/**
+ * Pairs of the He3 iHe3 with the hadrons of mixingDepth random collisions of its bin (event mixing), handed to
+ * emit(const MixedPair&). Uses the random generator and updates the hadron reuse counts.
+*/
+template <typename Emit>
+void Mixer::mixHe3(const size_t iHe3, HistogramsQA& histQA, Instrumentation& instrumentation, ScratchArena& arena,
+                   Emit&& emit)
+{
+    const int maxProcessTimes = 10;
+    HistVertexMultiplicity hVertexMultiplicity;
+    instrumentation.count(instrumentation::kHe3Processed);
+    arena.reset();
+
+    const He3Candidate& he3Cand = fHe3s[iHe3];
+    const CollisionCandidate& collCand = fCollisions[iHe3];
+    int iBin = fBinMerging.getPool(hVertexMultiplicity.getBinIndex(collCand.fZVertex, collCand.fCentralityFT0C));
+    histQA.hHe3Unique.fill(he3Cand.fPtHe3);
+    uint64_t nPairsHe3 = 0;     // hHe3AfterEM gets one entry per pair, added once per He3
+    const float rapidityHe3 = physics::rapidity(std::abs(he3Cand.fPtHe3), he3Cand.fEtaHe3, physics::mass::kHelium3);
+
+    for (size_t iDepth = 0; static_cast<int>(iDepth) < fMixingDepth; iDepth++)
+    {
+
+        if (fCollisionBrackets[iBin].size() == 0 || iDepth >= fCollisionBrackets[iBin].size())
+        {
+            instrumentation.count(instrumentation::kMixingDepthNotReached);
+            break;
+        }
+
+        int iCollEM;
+        iCollEM = fRandom.Integer(fCollisionBrackets[iBin].size());
+        const CollHadBracket& bracket = fCollisionBrackets[iBin][iCollEM];
+        const PartnerRanges ranges = getPartnerRanges(bracket, he3Cand.fPtHe3, rapidityHe3);
+        int collIDHad = bracket.CollID;
+        if (collIDHad == he3Cand.CollID)
+        {
+            instrumentation.count(instrumentation::kPairsRejectedSameCollision, ranges.getNHadrons());
+            continue;
+        }
+
+        for (int iRange = 0; iRange < ranges.fNRanges; iRange++)
+        {
+            const int firstHad = ranges.fFirst[iRange];
+            const int nHad = ranges.fEnd[iRange] - firstHad;
+            const PairKinematicsBatch kinematics = computePairKinematics(he3Cand, firstHad, nHad, arena, instrumentation);
+
+            // partner hadrons in the k* window and below the reuse cap
+            ArenaVector<int> partners = arena.allocateVector<int>(nHad);
+            for (int iHad = firstHad; iHad < firstHad + nHad; iHad++)
             {
-                hadronProcessTimes[iHad]++;
-                if (hadronProcessTimes[iHad] > maxProcessTimes)
+                if (fKstarMax > 0 && kinematics.fKstar[iHad - firstHad] > fKstarMax)
+                {
+                    instrumentation.count(instrumentation::kPairsRejectedKstar);
+                    continue;
+                }
+                fHadronProcessTimes[iHad]++;
+                if (fHadronProcessTimes[iHad] > maxProcessTimes)
                 {
+                    instrumentation.count(instrumentation::kPairsRejectedHadronCap);
                     continue;
                 }
+                partners.push_back(iHad);
+            }
 
-                const auto& hadCand = fHadrons[iHad];
-                li4Candidate.setHad(hadCand);
-                li4Candidate.setZVertex(collCand.fZVertex);
-                li4Candidate.setCentralityFT0C(collCand.fCentralityFT0C);
-                li4Candidate.setIs23(fIs23);
+            for (size_t iPair = 0; iPair < partners.size(); iPair++)
+            {
+                const bool isNegativeHad = partners[iPair] < bracket.GetSplit();
+                const int iKinematics = partners[iPair] - firstHad;
                 if (!true){ // conditions on the li4 pair
                     continue;
                 }
 
-                if (li4Candidate.getPtHe3() < 0) {
-                    if (li4Candidate.getPtHad() < 0.) {
-                        histQA.hInvMassAfterEMLikeSign->Fill(li4Candidate.calcInvMass());
+                if (he3Cand.fPtHe3 < 0) {
+                    if (isNegativeHad) {
+                        histQA.hInvMassAfterEMLikeSign.fill(kinematics.fInvMass[iKinematics]);
                     } else {
-                        histQA.hInvMassAfterEMUnlikeSign->Fill(li4Candidate.calcInvMass());
+                        histQA.hInvMassAfterEMUnlikeSign.fill(kinematics.fInvMass[iKinematics]);
                     }
                 }
-                histQA.hHe3AfterEM->Fill(he3Cand.fPtHe3);
-                outputTree->Fill();
+                nPairsHe3++;
+                emit(MixedPair{static_cast<int>(iHe3), partners[iPair], kinematics.get(iKinematics)});
+                instrumentation.count(instrumentation::kPairsGenerated);
             }
         }
     }
+    histQA.hHe3AfterEM.fill(he3Cand.fPtHe3, nPairsHe3);
 }
 
-void Mixer::performAngleMixing(TTree* outputTree, HistogramsQA& histQA)
+/**
+ * Pairs of the He3 iHe3 with the hadrons of its own collision, handed to emit(const MixedPair&).
+ * mixing::kRotation: the He3 is rotated in azimuth by a random angle (one per He3, from the random generator) and the
+ * pairs fill the mixed-event (AfterEM) QA histograms.
+ * mixing::kSameEvent: the pairs are the same-event ones and fill the same-event invariant-mass (BeforeEM) histograms.
+*/
+template <typename Emit>
+void Mixer::pairHe3WithOwnCollision(const size_t iHe3, const int strategy, HistogramsQA& histQA,
+                                    Instrumentation& instrumentation, ScratchArena& arena, Emit&& emit)
 {
-    Li4Candidate li4Candidate;
-    li4Candidate.setBranch(outputTree);
-
-    HistVertexMultiplicity hVertexMultiplicity;
-    
-    std::cout << "--------------------------------" << std::endl;
-    std::cout << "Starting angle mixing with " << fHadrons.size() << " hadrons and " 
-              << fHe3s.size() << " He3 candidates." << std::endl;
+    instrumentation.count(instrumentation::kHe3Processed);
+    arena.reset();
 
-    for (size_t iHe3 = 0; iHe3 < fHe3s.size(); iHe3++)
-    {
-        if (iHe3 % (fHe3s.size()/100) == 0) {
-            std::cout << "Processing He3 candidate " << iHe3 << " / " << fHe3s.size() << " (" 
-                      << static_cast<float>(iHe3)/fHe3s.size()*100 << "%)" << std::endl;
-        }
-
-        const He3Candidate& he3Cand = fHe3s[iHe3];
-        const CollisionCandidate& collCand = fCollisions[iHe3];
-        li4Candidate.setHe3(he3Cand);
-        int iBin = hVertexMultiplicity.getBinIndex(collCand.fZVertex, collCand.fCentralityFT0C);
-        histQA.hHe3Unique->Fill(he3Cand.fPtHe3);
+    He3Candidate he3Cand = fHe3s[iHe3];
+    const bool isSameEvent = strategy == mixing::kSameEvent;
+    if (!isSameEvent) {
+        he3Cand.fPhiHe3 = physics::rotateAngle(he3Cand.fPhiHe3, fRandom.Uniform(0, 2 * M_PI));
+        fRotatedPhiHe3[iHe3] = he3Cand.fPhiHe3;
+        histQA.hHe3Unique.fill(he3Cand.fPtHe3);
+    }
+    FixedBinHistogram& hInvMassLikeSign = isSameEvent ? histQA.hInvMassBeforeEMLikeSign : histQA.hInvMassAfterEMLikeSign;
+    FixedBinHistogram& hInvMassUnlikeSign = isSameEvent ? histQA.hInvMassBeforeEMUnlikeSign : histQA.hInvMassAfterEMUnlikeSign;
+    uint64_t nPairsHe3 = 0;     // hHe3AfterEM gets one entry per pair, added once per He3
+    const float rapidityHe3 = physics::rapidity(std::abs(he3Cand.fPtHe3), he3Cand.fEtaHe3, physics::mass::kHelium3);
 
-        int iBracketIdx = 0;
-        for (size_t iBracketIdx = 0; iBracketIdx < fCollisionBrackets[iBin].size(); ++iBracketIdx) {
-            if (fCollisionBrackets[iBin][iBracketIdx].CollID == he3Cand.CollID) {
-                break;
-            }
-        }
+    if (!fOwnBrackets[iHe3]) {
+        return;
+    }
 
-        for (int iHad = fCollisionBrackets[iBin][iBracketIdx].GetMin(); iHad <= fCollisionBrackets[iBin][iBracketIdx].GetMax(); iHad++) {
+    const CollHadBracket& bracket = *fOwnBrackets[iHe3];
+    const PartnerRanges ranges = getPartnerRanges(bracket, he3Cand.fPtHe3, rapidityHe3);
+    for (int iRange = 0; iRange < ranges.fNRanges; iRange++)
+    {
+        const int firstHad = ranges.fFirst[iRange];
+        const int nHad = ranges.fEnd[iRange] - firstHad;
+        const PairKinematicsBatch kinematics = computePairKinematics(he3Cand, firstHad, nHad, arena, instrumentation);
+        for (int iPair = 0; iPair < nHad; iPair++) {
             
-            li4Candidate.setHad(fHadrons[iHad]);
-            li4Candidate.setIs23(fIs23);
+            const bool isNegativeHad = firstHad + iPair < bracket.GetSplit();
+            if (fKstarMax > 0 && kinematics.fKstar[iPair] > fKstarMax) {
+                instrumentation.count(instrumentation::kPairsRejectedKstar);
+                continue;
+            }
             if (!true){ // conditions on the li4 pair
                 continue;
             }
-            if (li4Candidate.getPtHe3() < 0) {
-                if (li4Candidate.getPtHad() < 0.) {
-                    histQA.hInvMassAfterEMLikeSign->Fill(li4Candidate.calcInvMass());
+            if (he3Cand.fPtHe3 < 0) {
+                if (isNegativeHad) {
+                    hInvMassLikeSign.fill(kinematics.fInvMass[iPair]);
                 } else {
-                    histQA.hInvMassAfterEMUnlikeSign->Fill(li4Candidate.calcInvMass());
+                    hInvMassUnlikeSign.fill(kinematics.fInvMass[iPair]);
                 }
             }
-            histQA.hHe3AfterEM->Fill(he3Cand.fPtHe3);
-            outputTree->Fill();
+            nPairsHe3++;
+            emit(MixedPair{static_cast<int>(iHe3), firstHad + iPair, kinematics.get(iPair)});
+            instrumentation.count(instrumentation::kPairsGenerated);
         }
     }
+    if (!isSameEvent) {
+        histQA.hHe3AfterEM.fill(he3Cand.fPtHe3, nPairsHe3);
+    }
+}
+
+/**
+ * Hadron reuse counts, hadron momenta and own-collision brackets needed by a mixing strategy
+*/
+void Mixer::prepareMixing(const int strategy)
+{
+    prepareHadronMomenta();
+    if (strategy == mixing::kEvent)
+        fHadronProcessTimes.resize(fHadrons.size(), 0);
+    else
+        prepareOwnBrackets();
+    if (strategy == mixing::kRotation)
+        fRotatedPhiHe3.resize(fHe3s.size());
+}
+
+void Mixer::performEventMixing(TTree* outputTree, HistogramsQA& histQA, Instrumentation& instrumentation)
+{
+    ScopedTimer mixingTimer(instrumentation, instrumentation::kMixing);
+    Li4Candidate li4Candidate;
+    li4Candidate.setBranch(outputTree);
+    AsyncBatchWriter<MixedPair> output(makePairWriter(outputTree, mixing::kEvent, li4Candidate, instrumentation),
+                                       fAsyncOutput, fOutputBatchSize, fOutputBuffers);
+    prepareMixing(mixing::kEvent);
+    
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Starting event mixing with " << fHadrons.size() << " hadrons and " 
+              << fHe3s.size() << " He3 candidates." << std::endl;
+
+    ScratchArena& arena = getScratchArena();
+    ProgressReporter progress("He3", fHe3s.size() - std::min(fFirstHe3, fHe3s.size()));
+    instrumentation::Clock::time_point lastCheckpoint = instrumentation::Clock::now();
+    for (size_t iHe3 = fFirstHe3; iHe3 < fHe3s.size(); iHe3++)
+    {
+        checkpointIfDue(iHe3, output, lastCheckpoint);
+        progress.update(iHe3 - fFirstHe3, instrumentation.getCount(instrumentation::kPairsGenerated));
+        mixHe3(iHe3, histQA, instrumentation, arena, [&output](const MixedPair& pair) { output.push(pair); });
+    }
+    output.finish();
+    progress.finish(instrumentation.getCount(instrumentation::kPairsGenerated));
+}
+
+/**
+ * Bracket of the collision of each He3 (nullptr if none of its hadrons was stored). The collisions are stored in
+ * increasing CollID, so the collision of each bracket is found by binary search.
+*/
+void Mixer::prepareOwnBrackets()
+{
+    // rebuilt at every pairing: the brackets are shared and may have been refilled or reordered since the last one
+    fOwnBrackets.assign(fHe3s.size(), nullptr);
+    for (const auto& binBrackets : fCollisionBrackets)
+        for (const CollHadBracket& bracket : binBrackets)
+        {
+            const auto collision = std::lower_bound(fCollisions.begin(), fCollisions.end(), bracket.CollID,
+                [](const CollisionCandidate& collCand, const int collID) { return collCand.CollID < collID; });
+            if (collision != fCollisions.end() && collision->CollID == bracket.CollID)
+                fOwnBrackets[collision - fCollisions.begin()] = &bracket;
+        }
+}
+
+/**
+ * Pairs of each He3 with the hadrons of its own collision (see pairHe3WithOwnCollision), with the same pair selections
+ * and output as the mixing
+*/
+void Mixer::pairWithOwnCollision(TTree* outputTree, const int strategy, HistogramsQA& histQA, Instrumentation& instrumentation)
+{
+    ScopedTimer mixingTimer(instrumentation, instrumentation::kMixing);
+    Li4Candidate li4Candidate;
+    li4Candidate.setBranch(outputTree);
+    AsyncBatchWriter<MixedPair> output(makePairWriter(outputTree, strategy, li4Candidate, instrumentation),
+                                       fAsyncOutput, fOutputBatchSize, fOutputBuffers);
+    prepareMixing(strategy);
+    
+    std::cout << "--------------------------------" << std::endl;
+    std::cout << "Starting " << (strategy == mixing::kSameEvent ? "same-event pairing" : "angle mixing") << " with "
+              << fHadrons.size() << " hadrons and " << fHe3s.size() << " He3 candidates." << std::endl;
+
+    ScratchArena& arena = getScratchArena();
+    ProgressReporter progress("He3", fHe3s.size() - std::min(fFirstHe3, fHe3s.size()));
+    instrumentation::Clock::time_point lastCheckpoint = instrumentation::Clock::now();
+    for (size_t iHe3 = fFirstHe3; iHe3 < fHe3s.size(); iHe3++)
+    {
+        checkpointIfDue(iHe3, output, lastCheckpoint);
+        progress.update(iHe3 - fFirstHe3, instrumentation.getCount(instrumentation::kPairsGenerated));
+        pairHe3WithOwnCollision(iHe3, strategy, histQA, instrumentation, arena, [&output](const MixedPair& pair) { output.push(pair); });
+    }
+    output.finish();
+    progress.finish(instrumentation.getCount(instrumentation::kPairsGenerated));
+}
+
+/**
+ * Rotation mixing: each He3, rotated in azimuth by a random angle, is paired with the hadrons of its own collision.
+ * The rotation removes the correlation of the pair while keeping the event properties of the same-event pairs. The
+ * He3 is written with its rotated azimuth.
+*/
+void Mixer::performAngleMixing(TTree* outputTree, HistogramsQA& histQA, Instrumentation& instrumentation)
+{
+    pairWithOwnCollision(outputTree, mixing::kRotation, histQA, instrumentation);
+}
+
+/**
+ * Same-event pairs of the stored candidates, written with the same columns as the mixed pairs, so that the numerator
+ * and the denominator of the correlation function are produced from one ingestion (e.g. as two mixingJobs).
+ * Each stored He3 is paired with the stored hadrons of its collision. Only the first He3 of each collision is stored,
+ * so in a collision with several selected He3s the pairs of the other He3s are missing, and the first He3 is paired
+ * with the hadron entries of all of them. The pairs fill the same-event invariant-mass (BeforeEM) QA histograms.
+*/
+void Mixer::performSameEvent(TTree* outputTree, HistogramsQA& histQA, Instrumentation& instrumentation)
+{
+    pairWithOwnCollision(outputTree, mixing::kSameEvent, histQA, instrumentation);
+}
+
+/**
+ * Pull interface of a Mixer: the pairs are produced on demand, in batches of whole He3s, instead of being written to
+ * a tree. Each pair holds the He3 and hadron indices in the Mixer's candidates and the pair kinematics; the memory
+ * used does not depend on the number of pairs. The pairs, their order, the QA histograms and the instrumentation are
+ * those of the corresponding perform method (same seed, first He3 and reuse counts), and the generator advances the
+ * state of the Mixer in the same way.
+ *
+ *     PairGenerator generator(mixer, mixing::kEvent, histQA, instrumentation);
+ *     std::vector<MixedPair> batch;
+ *     while (generator.next(batch))
+ *         for (const MixedPair& pair : batch)
+ *             ...
+*/
+class PairGenerator
+{
+    public:
+        PairGenerator(Mixer& mixer, const int strategy, HistogramsQA& histQA, Instrumentation& instrumentation,
+                      const size_t batchSize = 4096);
+        ~PairGenerator() = default;
+
+        bool next(std::vector<MixedPair>& batch);
+        inline size_t getNextHe3() const { return fNextHe3; }
+
+    private:
+        Mixer& fMixer;
+        int fStrategy;
+        HistogramsQA& fHistQA;
+        Instrumentation& fInstrumentation;
+        size_t fBatchSize;
+        size_t fNextHe3;
+};
+
+/**
+ * @param strategy mixing::MixingStrategy of the pairs
+*/
+PairGenerator::PairGenerator(Mixer& mixer, const int strategy, HistogramsQA& histQA, Instrumentation& instrumentation,
+                             const size_t batchSize)
+    : fMixer(mixer), fStrategy(strategy), fHistQA(histQA), fInstrumentation(instrumentation), fBatchSize(batchSize),
+      fNextHe3(mixer.fFirstHe3)
+{
+    fMixer.prepareMixing(strategy);
+}
+
+/**
+ * Replace the content of batch with the pairs of the next He3s, at least batchSize pairs unless the last He3 is reached
+ * (a batch ends with the last pair of a He3)
+ * @return false when no pair is left
+*/
+bool PairGenerator::next(std::vector<MixedPair>& batch)
+{
+    ScopedTimer mixingTimer(fInstrumentation, instrumentation::kMixing);
+    batch.clear();
+    ScratchArena& arena = fMixer.getScratchArena();
+    auto emit = [&batch](const MixedPair& pair) { batch.push_back(pair); };
+    while (fNextHe3 < fMixer.fHe3s.size() && batch.size() < fBatchSize)
+    {
+        if (fStrategy == mixing::kEvent)
+            fMixer.mixHe3(fNextHe3, fHistQA, fInstrumentation, arena, emit);
+        else
+            fMixer.pairHe3WithOwnCollision(fNextHe3, fStrategy, fHistQA, fInstrumentation, arena, emit);
+        fNextHe3++;
+    }
+    return !batch.empty();
 }
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <Riostream.h>
+#include <TDirectory.h>
+#include <TTree.h>
+
+#include "../core/candidates.hh"
+#include "../core/coldStore.hh"
+#include "li4candidates.hh"
+
+/**
+ * Event pool of a mixing run: the stored candidates (hot and cold fields), their collisions and the hadron reuse
+ * counts. Saved at the end of a run and loaded by the next one to mix only new data (incremental mixing).
+ * The candidates are stored with the input branch names, plus CollID, the collision z vertex and centrality and,
+ * for the hadrons, the reuse count.
+*/
+namespace mixingPool {
+
+    const char * kHadronTreeName = "PoolHadrons";
+    const char * kHe3TreeName = "PoolHe3s";
+
+    void savePool(TDirectory * directory, const std::vector<HadCandidate>& hadrons, const std::vector<He3Candidate>& he3s,
+                  const std::vector<CollisionCandidate>& collisions,
+                  ColdStore<HadColdFields>& hadronsCold, ColdStore<He3ColdFields>& he3sCold,
+                  const std::vector<int>& hadronProcessTimes)
+    {
+        directory->cd();
+
+        HadCandidate hadCand;
+        HadColdFields hadCold;
+        int processTimes = 0;
+        auto hadronTree = new TTree(kHadronTreeName, kHadronTreeName);
+        hadCand.setBranch(hadronTree);
+        hadCold.setBranch(hadronTree);
+        hadronTree->Branch("CollID", &hadCand.CollID);
+        hadronTree->Branch("fZHad", &hadCand.fZHad);
+        hadronTree->Branch("fCentralityFT0C", &hadCand.fCentralityFT0C);
+        hadronTree->Branch("fProcessTimes", &processTimes);
+        for (size_t iHad = 0; iHad < hadrons.size(); iHad++)
+        {
+            hadCand = hadrons[iHad];
+            hadCold = hadronsCold.get(hadCand.fColdIndex);
+            processTimes = iHad < hadronProcessTimes.size() ? hadronProcessTimes[iHad] : 0;
+            hadronTree->Fill();
+        }
+        hadronTree->Write();
+
+        He3Candidate he3Cand;
+        He3ColdFields he3Cold;
+        CollisionCandidate collCand;
+        auto he3Tree = new TTree(kHe3TreeName, kHe3TreeName);
+        he3Cand.setBranch(he3Tree);
+        he3Cold.setBranch(he3Tree);
+        he3Tree->Branch("CollID", &he3Cand.CollID);
+        he3Tree->Branch("fZVertex", &collCand.fZVertex);
+        he3Tree->Branch("fCentralityFT0C", &collCand.fCentralityFT0C);
+        for (size_t iHe3 = 0; iHe3 < he3s.size(); iHe3++)
+        {
+            he3Cand = he3s[iHe3];
+            he3Cold = he3sCold.get(he3Cand.fColdIndex);
+            collCand = collisions[iHe3];
+            he3Tree->Fill();
+        }
+        he3Tree->Write();
+    }
+
+    /**
+     * Append the pool saved in directory to the candidate vectors (expected empty) and the cold stores.
+     * @return false if the directory contains no pool
+    */
+    bool loadPool(TDirectory * directory, std::vector<HadCandidate>& hadrons, std::vector<He3Candidate>& he3s,
+                  std::vector<CollisionCandidate>& collisions,
+                  ColdStore<HadColdFields>& hadronsCold, ColdStore<He3ColdFields>& he3sCold,
+                  std::vector<int>& hadronProcessTimes)
+    {
+        auto hadronTree = directory->Get<TTree>(kHadronTreeName);
+        auto he3Tree = directory->Get<TTree>(kHe3TreeName);
+        if (!hadronTree || !he3Tree)
+        {
+            std::cerr << "No mixing pool found in " << directory->GetName() << std::endl;
+            return false;
+        }
+
+        HadCandidate hadCand;
+        HadColdFields hadCold;
+        int processTimes = 0;
+        hadCand.setBranchAddress(hadronTree);
+        hadCold.setBranchAddress(hadronTree);
+        hadronTree->SetBranchAddress("CollID", &hadCand.CollID);
+        hadronTree->SetBranchAddress("fZHad", &hadCand.fZHad);
+        hadronTree->SetBranchAddress("fCentralityFT0C", &hadCand.fCentralityFT0C);
+        hadronTree->SetBranchAddress("fProcessTimes", &processTimes);
+        for (Long64_t iEntry = 0; iEntry < hadronTree->GetEntries(); iEntry++)
+        {
+            hadronTree->GetEntry(iEntry);
+            hadCand.fColdIndex = hadronsCold.add(hadCold, iEntry);
+            hadrons.emplace_back(hadCand);
+            hadronProcessTimes.push_back(processTimes);
+        }
+
+        He3Candidate he3Cand;
+        He3ColdFields he3Cold;
+        CollisionCandidate collCand;
+        he3Cand.setBranchAddress(he3Tree);
+        he3Cold.setBranchAddress(he3Tree);
+        he3Tree->SetBranchAddress("CollID", &he3Cand.CollID);
+        he3Tree->SetBranchAddress("fZVertex", &collCand.fZVertex);
+        he3Tree->SetBranchAddress("fCentralityFT0C", &collCand.fCentralityFT0C);
+        for (Long64_t iEntry = 0; iEntry < he3Tree->GetEntries(); iEntry++)
+        {
+            he3Tree->GetEntry(iEntry);
+            he3Cand.fColdIndex = he3sCold.add(he3Cold, iEntry);
+            collCand.CollID = he3Cand.CollID;
+            he3s.emplace_back(he3Cand);
+            collisions.emplace_back(collCand);
+        }
+
+        std::cout << "Loaded mixing pool: " << hadrons.size() << " hadrons, " << he3s.size() << " He3 candidates." << std::endl;
+        return true;
+    }
+
+}   // namespace mixingPool
@@ -4,6 +4,8 @@
 #include "Math/Boost.h"
 #include "Math/Vector4D.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <string>
@@ -15,6 +17,8 @@
 #include <TMath.h>
 #include <TSystem.h>
 
+#include "../core/lookupTable.hh"
+
 using std::map;
 using std::string;
 using std::vector;
@@ -107,52 +111,81 @@ double BetheBlochParametrisation(double bg, double kp1, double kp2, double kp3,
   return (kp2 - aa - bb) * kp1 / aa;
 }
 
-float BetheBlochHe(const float momentum)  {
+float BetheBlochHeAnalytic(const float momentum)  {
   float betagamma = std::abs(momentum) / constant::kMass[static_cast<int>(species::kHe)];
   return BetheBlochParametrisation(betagamma, parametrisation::kHeTPCParams[0], parametrisation::kHeTPCParams[1],
                                    parametrisation::kHeTPCParams[2], parametrisation::kHeTPCParams[3],
                                    parametrisation::kHeTPCParams[4]);
 }
 
+float BetheBlochHe(const float momentum);
+
 float ComputeNsigmaTPCHe(const float momentum, const float tpcSignal) {
   return (tpcSignal / BetheBlochHe(std::abs(momentum)) - 1.) / parametrisation::kHeTPCResolution;
 }
 
 // -------------------------------------------- ITS ----------------------------------------------------
 
+/**
+ * Sum, number and largest of the 4-bit cluster sizes of the 7 ITS layers packed in itsClusterSizes, without branches.
+ * The sum and the number of clusters are computed on the whole word (SWAR): the nibbles are added pairwise into
+ * bytes and the bytes are summed by a multiplication, the non-empty layers are flagged in the lowest bit of their
+ * nibble and counted the same way.
+*/
+inline void DecodeClusterSizes(const uint32_t itsClusterSizes, int& sum, int& nClusters, int& max) {
+  const uint32_t sizes = itsClusterSizes & 0x0FFFFFFFu;
+  const uint32_t pairSums = (sizes & 0x0F0F0F0Fu) + ((sizes >> 4) & 0x0F0F0F0Fu);
+  sum = static_cast<int>((pairSums * 0x01010101u) >> 24);
+  const uint32_t nonEmpty = (sizes | (sizes >> 1) | (sizes >> 2) | (sizes >> 3)) & 0x01111111u;
+  nClusters = static_cast<int>((nonEmpty * 0x11111111u) >> 28);
+  const int max01 = std::max<int>(sizes & 0xf, (sizes >> 4) & 0xf);
+  const int max23 = std::max<int>((sizes >> 8) & 0xf, (sizes >> 12) & 0xf);
+  const int max45 = std::max<int>((sizes >> 16) & 0xf, (sizes >> 20) & 0xf);
+  max = std::max(std::max(max01, max23), std::max<int>(max45, (sizes >> 24) & 0xf));
+}
+
+/**
+ * Mean and truncated mean (largest cluster removed) of the cluster sizes, 0 without clusters.
+ * The truncated mean is the mean for tracks with a single cluster. The cases are selected arithmetically on the
+ * integers, so that no branch is generated around the divisions.
+*/
+inline void AverageFromClusterSizes(const int sum, const int nClusters, const int max, float& mean, float& truncatedMean) {
+  const int isEmpty = nClusters == 0;
+  const int isTruncated = nClusters > 1;
+  mean = static_cast<float>(sum) / static_cast<float>(nClusters + isEmpty);
+  truncatedMean = static_cast<float>(sum - isTruncated * max) / static_cast<float>(nClusters - isTruncated + isEmpty);
+}
+
 float ComputeAverageClusterSize(const uint32_t itsClusterSizes, const bool useTruncatedMean = false)  {
-  float sum = 0;
-  int nclusters = 0;
-  int max = 0;
-  for (int layer = 0; layer < 7; layer++) {
-    int clsize = (itsClusterSizes >> (layer * 4)) & 0xf;
-    if (clsize > 0) {
-      nclusters++;
-      sum += clsize;
-      if (clsize > max) {
-        max = clsize;
-      }
-    }
-  }
-  
-  if (nclusters == 0) {
-    return 0;
-  }
-  
-  if (useTruncatedMean && nclusters > 1) {
-    return (sum - max) / (nclusters - 1);
-  }
-  return sum / nclusters;
+  int sum, nclusters, max;
+  DecodeClusterSizes(itsClusterSizes, sum, nclusters, max);
+  float mean, truncatedMean;
+  AverageFromClusterSizes(sum, nclusters, max, mean, truncatedMean);
+  return useTruncatedMean ? truncatedMean : mean;
 };
 
+/**
+ * Batch version of ComputeAverageClusterSize: mean and truncated mean of n packed words.
+ * The loop has no branches, so that the compiler vectorises it (several tracks per instruction).
+*/
+void ComputeAverageClusterSizes(const uint32_t * itsClusterSizes, const size_t n, float * mean, float * truncatedMean)  {
+  for (size_t iTrack = 0; iTrack < n; iTrack++) {
+    int sum, nclusters, max;
+    DecodeClusterSizes(itsClusterSizes[iTrack], sum, nclusters, max);
+    AverageFromClusterSizes(sum, nclusters, max, mean[iTrack], truncatedMean[iTrack]);
+  }
+}
 
-float ComputeExpectedClusterSizeCosLambda(const float momentum, const int iSpecies) { 
+
+float ComputeExpectedClusterSizeCosLambdaAnalytic(const float momentum, const int iSpecies) { 
   const float mass = constant::kMass[iSpecies];
   const std::array<float, 3>& parameters = parametrisation::kITSParams[iSpecies];
   const float betagamma = std::abs(momentum) / mass;
   return parameters[0] / std::pow(betagamma, parameters[1]) + parameters[2];
 }
 
+float ComputeExpectedClusterSizeCosLambda(const float momentum, const int iSpecies);
+
 float ComputeExpectedClusterSizeCosLambdaHe(const float momentum) {
   return ComputeExpectedClusterSizeCosLambda(momentum, static_cast<int>(species::kHe));
 }
@@ -215,6 +248,58 @@ float ComputeNsigmaTOFPr(const float pt, const float tofMass) {
   return (tofMass - expected) / (resolution * expected);
 }
 
+// ------------------------------------------ Lookup tables --------------------------------------------
+
+/**
+ * Tabulated TPC and ITS expected signals (cubic interpolation in momentum), replacing the analytic parametrisations
+ * once built. The tables cover the momenta of the selected candidates, the parametrisations are evaluated outside.
+ * The TOF expectation and the resolutions are low-order polynomials and are not tabulated.
+*/
+namespace lookupTables
+{
+    bool gUseLookupTables = false;
+    const float kMomentumMin = 0.1; // GeV/c
+    const float kMomentumMax = 10.; // GeV/c
+
+    LookupTable kBetheBlochHe;
+    LookupTable kExpectedClusterSizeCosLambda[static_cast<int>(species::kNspecies)];
+
+    /**
+     * @param maxRelativeError Bound on the relative difference to the parametrisations, checked when building
+     * @return false if a table does not reach the bound (the tables are used anyway)
+    */
+    bool buildLookupTables(const float maxRelativeError = 1.e-4) {
+      bool isAccurate = kBetheBlochHe.build([](const float momentum) { return BetheBlochHeAnalytic(momentum); },
+                                            kMomentumMin, kMomentumMax, maxRelativeError);
+      for (int iSpecies = 0; iSpecies < static_cast<int>(species::kNspecies); iSpecies++) {
+        isAccurate &= kExpectedClusterSizeCosLambda[iSpecies].build(
+          [iSpecies](const float momentum) { return ComputeExpectedClusterSizeCosLambdaAnalytic(momentum, iSpecies); },
+          kMomentumMin, kMomentumMax, maxRelativeError);
+      }
+      gUseLookupTables = true;
+      return isAccurate;
+    }
+
+    /**
+     * @return largest relative difference of the tables to the parametrisations, measured when building them
+    */
+    float getMaxRelativeError() {
+      float maxRelativeError = kBetheBlochHe.getMaxRelativeError();
+      for (const LookupTable& table : kExpectedClusterSizeCosLambda)
+        maxRelativeError = std::max(maxRelativeError, table.getMaxRelativeError());
+      return maxRelativeError;
+    }
+}
+
+float BetheBlochHe(const float momentum)  {
+  return lookupTables::gUseLookupTables ? lookupTables::kBetheBlochHe(std::abs(momentum)) : BetheBlochHeAnalytic(momentum);
+}
+
+float ComputeExpectedClusterSizeCosLambda(const float momentum, const int iSpecies) {
+  return lookupTables::gUseLookupTables ? lookupTables::kExpectedClusterSizeCosLambda[iSpecies](std::abs(momentum)) 
+                                        : ComputeExpectedClusterSizeCosLambdaAnalytic(momentum, iSpecies);
+}
+
 // -------------------------------------- PID in Tracking ----------------------------------------------
 
 float CorrectPidTrkHe(const float momentum) {
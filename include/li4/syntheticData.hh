@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <TTree.h>
+#include <TRandom3.h>
+
+#include "li4candidates.hh"
+
+namespace synthetic {
+
+    /**
+     * Fill trees with the same layout as O2he3hadtable and O2he3hadmult with random candidates.
+     * Each collision hosts one He3 and a Poisson number of hadrons (at least one), one entry per (He3, hadron) pair,
+     * as produced by the upstream task.
+     * @param candidateTree Tree with the O2he3hadtable branches (created here).
+     * @param collisionTree Tree with the O2he3hadmult branches (created here).
+     * @param nCollisions Number of collisions to generate.
+     * @param meanMultiplicity Mean number of hadrons per collision.
+     * @param seed Seed of the local random generator (gRandom is not touched).
+    */
+    void fillSyntheticTrees(TTree * candidateTree, TTree * collisionTree, const int nCollisions,
+                            const float meanMultiplicity = 5., const int seed = 42)
+    {
+        TRandom3 random(seed);
+
+        He3Candidate he3;
+        HadCandidate had;
+        He3ColdFields he3Cold;
+        HadColdFields hadCold;
+        CollisionCandidate coll;
+
+        candidateTree->Branch("fPtHe3", &he3.fPtHe3);
+        candidateTree->Branch("fEtaHe3", &he3.fEtaHe3);
+        candidateTree->Branch("fPhiHe3", &he3.fPhiHe3);
+        candidateTree->Branch("fDCAxyHe3", &he3.fDCAxyHe3);
+        candidateTree->Branch("fDCAzHe3", &he3.fDCAzHe3);
+        candidateTree->Branch("fSignalTPCHe3", &he3Cold.fSignalTPCHe3);
+        candidateTree->Branch("fInnerParamTPCHe3", &he3Cold.fInnerParamTPCHe3);
+        candidateTree->Branch("fMassTOFHe3", &he3Cold.fMassTOFHe3);
+        candidateTree->Branch("fNClsTPCHe3", &he3.fNClsTPCHe3);
+        candidateTree->Branch("fItsClusterSizeHe3", &he3.fItsClusterSizeHe3);
+        candidateTree->Branch("fPIDtrkHe3", &he3.fPIDtrkHe3);
+        candidateTree->Branch("fSharedClustersHe3", &he3Cold.fSharedClustersHe3);
+        candidateTree->Branch("fNSigmaTPCHe3", &he3.fNSigmaTPCHe3);
+        candidateTree->Branch("fChi2TPCHe3", &he3.fChi2TPCHe3);
+
+        candidateTree->Branch("fPtHad", &had.fPtHad);
+        candidateTree->Branch("fEtaHad", &had.fEtaHad);
+        candidateTree->Branch("fPhiHad", &had.fPhiHad);
+        candidateTree->Branch("fDCAxyHad", &had.fDCAxyHad);
+        candidateTree->Branch("fDCAzHad", &had.fDCAzHad);
+        candidateTree->Branch("fSignalTPCHad", &hadCold.fSignalTPCHad);
+        candidateTree->Branch("fInnerParamTPCHad", &hadCold.fInnerParamTPCHad);
+        candidateTree->Branch("fMassTOFHad", &hadCold.fMassTOFHad);
+        candidateTree->Branch("fItsClusterSizeHad", &had.fItsClusterSizeHad);
+        candidateTree->Branch("fPIDtrkHad", &had.fPIDtrkHad);
+        candidateTree->Branch("fSharedClustersHad", &hadCold.fSharedClustersHad);
+        candidateTree->Branch("fNSigmaTPCHadPr", &had.fNSigmaTPCHad);
+        candidateTree->Branch("fNSigmaTOFHadPr", &had.fNSigmaTOFHad);
+        candidateTree->Branch("fChi2TPCHad", &had.fChi2TPCHad);
+
+        collisionTree->Branch("fZVertex", &coll.fZVertex);
+        collisionTree->Branch("fCentralityFT0C", &coll.fCentralityFT0C);
+
+        auto randomClusterSizes = [&random]() {
+            unsigned int clusterSizes = 0;
+            for (int layer = 0; layer < 7; layer++)
+                clusterSizes |= (static_cast<unsigned int>(random.Integer(8)) & 0xf) << (layer * 4);
+            return clusterSizes;
+        };
+
+        for (int iCollision = 0; iCollision < nCollisions; iCollision++)
+        {
+            coll.fZVertex = random.Uniform(-10., 10.);
+            coll.fCentralityFT0C = random.Uniform(0., 100.);
+
+            const float chargeHe3 = random.Uniform() < 0.5 ? -1. : 1.;
+            he3.fPtHe3 = chargeHe3 * random.Uniform(0.8, 4.);
+            he3.fEtaHe3 = random.Uniform(-1., 1.);
+            he3.fPhiHe3 = random.Uniform(-M_PI, M_PI);
+            he3.fDCAxyHe3 = random.Gaus(0., 0.005);
+            he3.fDCAzHe3 = random.Gaus(0., 0.005);
+            he3Cold.fSignalTPCHe3 = random.Gaus(400., 30.);
+            he3Cold.fInnerParamTPCHe3 = std::abs(he3.fPtHe3) * std::cosh(he3.fEtaHe3);
+            he3Cold.fMassTOFHe3 = random.Gaus(2.8, 0.1);
+            he3.fNClsTPCHe3 = static_cast<unsigned char>(random.Integer(60) + 100);
+            he3.fItsClusterSizeHe3 = randomClusterSizes();
+            he3.fPIDtrkHe3 = random.Uniform() < 0.8 ? 7 : 6;
+            he3Cold.fSharedClustersHe3 = static_cast<unsigned char>(random.Integer(3));
+            he3.fNSigmaTPCHe3 = random.Gaus(0., 1.);
+            he3.fChi2TPCHe3 = random.Uniform(0.3, 4.5);
+
+            const int nHadrons = std::max(1, random.Poisson(meanMultiplicity));
+            for (int iHadron = 0; iHadron < nHadrons; iHadron++)
+            {
+                const float chargeHad = random.Uniform() < 0.5 ? -1. : 1.;
+                had.fPtHad = chargeHad * random.Uniform(0.3, 3.);
+                had.fEtaHad = random.Uniform(-1., 1.);
+                had.fPhiHad = random.Uniform(-M_PI, M_PI);
+                had.fDCAxyHad = random.Gaus(0., 0.003);
+                had.fDCAzHad = random.Gaus(0., 0.003);
+                hadCold.fSignalTPCHad = random.Gaus(80., 8.);
+                hadCold.fInnerParamTPCHad = std::abs(had.fPtHad) * std::cosh(had.fEtaHad);
+                hadCold.fMassTOFHad = random.Gaus(0.938, 0.05);
+                had.fItsClusterSizeHad = randomClusterSizes();
+                had.fPIDtrkHad = 4;
+                hadCold.fSharedClustersHad = static_cast<unsigned char>(random.Integer(3));
+                had.fNSigmaTPCHad = random.Gaus(0., 1.5);
+                had.fNSigmaTOFHad = random.Gaus(0., 1.5);
+                had.fChi2TPCHad = random.Uniform(0.5, 4.5);
+
+                candidateTree->Fill();
+                collisionTree->Fill();
+            }
+        }
+    }
+
+}   // namespace synthetic
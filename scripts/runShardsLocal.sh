@@ -0,0 +1,46 @@
+#!/bin/bash
+# Run mixingLi4 as several local processes, one per shard of z-vertex/centrality bins, and merge the partial outputs.
+# The input has to be merged beforehand (doMerge: false in the configuration).
+# With nShards "numa", one shard per NUMA node is run (with numaBinding: true each shard is bound to its node).
+# usage: scripts/runShardsLocal.sh <config.yml> <nShards|numa> [build directory]
+
+set -euo pipefail
+
+CONFIG=${1:?"configuration file required"}
+NSHARDS=${2:?"number of shards required"}
+BUILD_DIR=${3:-build}
+
+if [[ "${NSHARDS}" == "numa" ]]; then
+    NSHARDS=1
+    if [[ -r /sys/devices/system/node/online ]]; then
+        NSHARDS=$(ls -d /sys/devices/system/node/node[0-9]* | while read -r NODE; do
+            [[ -n "$(cat "${NODE}/cpulist")" ]] && echo "${NODE}"; done | wc -l)
+    fi
+fi
+
+OUTPUT=$(grep -E '^outputFileName:' "${CONFIG}" | sed -E 's/^outputFileName:[[:space:]]*"?([^"]*)"?.*/\1/')
+STEM=${OUTPUT%.root}
+
+PIDS=()
+for ((ISHARD = 0; ISHARD < NSHARDS; ISHARD++)); do
+    "${BUILD_DIR}/mixingLi4" "${CONFIG}" "${ISHARD}" "${NSHARDS}" > "${STEM}_shard${ISHARD}of${NSHARDS}.log" 2>&1 &
+    PIDS+=($!)
+done
+
+# a failed shard leaves an incomplete partial output: do not merge
+FAILED=0
+for ((ISHARD = 0; ISHARD < NSHARDS; ISHARD++)); do
+    if ! wait "${PIDS[ISHARD]}"; then
+        echo "Shard ${ISHARD} of ${NSHARDS} failed, see ${STEM}_shard${ISHARD}of${NSHARDS}.log" >&2
+        FAILED=1
+    fi
+done
+if ((FAILED)); then
+    exit 1
+fi
+
+PARTIALS=()
+for ((ISHARD = 0; ISHARD < NSHARDS; ISHARD++)); do
+    PARTIALS+=("${STEM}_shard${ISHARD}of${NSHARDS}.root")
+done
+"${BUILD_DIR}/mergeShards" "${OUTPUT}" "${PARTIALS[@]}"
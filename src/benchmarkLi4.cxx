@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <TString.h>
+#include <TTree.h>
+#include <TFile.h>
+#include <TH1F.h>
+#include <TROOT.h>
+
+#include <TRandom3.h>
+
+#include "../include/core/benchmarkUtils.hh"
+#include "../include/core/fixedBinHistogram.hh"
+#include "../include/core/instrumentation.hh"
+#include "../include/core/numaTopology.hh"
+#include "../include/core/sharding.hh"
+#include "../include/li4/columnarInput.hh"
+#include "../include/li4/li4candidates.hh"
+#include "../include/li4/mixing.hh"
+#include "../include/li4/syntheticData.hh"
+
+// heap allocations of the process, counted by the global operator new of the standalone executable (steady-state
+// check of the mixing loop)
+std::atomic<long long> gNHeapAllocations{0};
+#ifdef EVENTMIXING_STANDALONE
+const bool kCountsHeapAllocations = true;
+
+void * operator new(std::size_t size)
+{
+    gNHeapAllocations++;
+    if (void * pointer = std::malloc(size > 0 ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment)
+{
+    gNHeapAllocations++;
+    const size_t alignmentBytes = static_cast<size_t>(alignment);
+    if (void * pointer = std::aligned_alloc(alignmentBytes, (std::max<size_t>(size, 1) + alignmentBytes - 1) / alignmentBytes * alignmentBytes))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * pointer) noexcept { std::free(pointer); }
+void operator delete(void * pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void * pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void * pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+#else
+const bool kCountsHeapAllocations = false;
+#endif
+
+/**
+ * Tree whose Fill counts apart the heap allocations made inside ROOT (baskets, offsets), so that the steady-state
+ * check covers the pair output up to the tree
+*/
+class AllocationCountingTree : public TTree
+{
+    public:
+        AllocationCountingTree(const char * name, const char * title) : TTree(name, title) {}
+        ~AllocationCountingTree() = default;
+
+        Int_t Fill() override
+        {
+            const long long allocationsBefore = gNHeapAllocations.load();
+            const Int_t nBytes = TTree::Fill();
+            fFillAllocations += gNHeapAllocations.load() - allocationsBefore;
+            return nBytes;
+        }
+        long long getFillAllocations() const { return fFillAllocations; }
+
+    private:
+        long long fFillAllocations = 0;
+};
+
+/**
+ * Benchmark suite for the Li4 event mixing.
+ * Synthetic O2he3hadtable/O2he3hadmult trees are generated in memory and each stage of the workflow is timed
+ * separately. Results are printed and written to a JSON file that can be tracked across versions.
+ * @param nCollisions Number of synthetic collisions (one He3 each).
+ * @param meanMultiplicity Mean number of hadrons per collision.
+ * @param mixingDepth Mixing depth passed to the Mixer.
+ * @param minTime Minimum accumulated time per benchmark (s), each benchmark runs at least once.
+ * @param outputJsonName Name of the JSON output file.
+ * @param outputRootName Name of the scratch ROOT file used by the output-writing benchmark.
+ * @param version Free label stored in the JSON context (e.g. a git hash).
+ * @return false if a validation failed (e.g. the mixing loop allocated in its steady state).
+*/
+bool benchmarkLi4(const int nCollisions = 20000, const float meanMultiplicity = 5., const int mixingDepth = 4,
+                  const double minTime = 1., const char * outputJsonName = "benchmarkLi4.json",
+                  const char * outputRootName = "benchmarkLi4Output.root", const char * version = "dev")
+{
+    const int randomSeed = 42;
+    const bool is23 = true;
+    ROOT::EnableThreadSafety();     // asynchronous reader and writer benchmarks
+
+    benchmarkUtils::BenchmarkSuite suite(minTime);
+    suite.addContext("version", version);
+    suite.addContext("nCollisions", std::to_string(nCollisions));
+    suite.addContext("meanMultiplicity", std::to_string(meanMultiplicity));
+    suite.addContext("mixingDepth", std::to_string(mixingDepth));
+    bool validationsPassed = true;      // checks that must hold whatever the timings, they fail the run
+
+    TTree * inputCandidateTree = new TTree("O2he3hadtable", "O2he3hadtable");
+    TTree * inputCollisionTree = new TTree("O2he3hadmult", "O2he3hadmult");
+    synthetic::fillSyntheticTrees(inputCandidateTree, inputCollisionTree, nCollisions, meanMultiplicity, randomSeed);
+    const long long nEntries = inputCandidateTree->GetEntries();
+    const double inputBytes = inputCandidateTree->GetTotBytes() + inputCollisionTree->GetTotBytes();
+    suite.addContext("nEntries", std::to_string(nEntries));
+
+    HistogramsQA histQA;
+    Instrumentation instrumentation;
+
+    // raw entries, used by the per-candidate benchmarks
+    std::vector<He3Candidate> rawHe3s(nEntries);
+    std::vector<HadCandidate> rawHadrons(nEntries);
+    std::vector<CollisionCandidate> rawCollisions(nEntries);
+    {
+        He3Candidate he3Cand;
+        HadCandidate hadCand;
+        CollisionCandidate collCand;
+        he3Cand.setBranchAddress(inputCandidateTree);
+        hadCand.setBranchAddress(inputCandidateTree);
+        collCand.setBranchAddress(inputCollisionTree);
+        for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+        {
+            inputCandidateTree->GetEntry(iEntry);
+            inputCollisionTree->GetEntry(iEntry);
+            rawHe3s[iEntry] = he3Cand;
+            rawHadrons[iEntry] = hadCand;
+            rawCollisions[iEntry] = collCand;
+        }
+    }
+
+    std::vector<He3Candidate> he3Candidates;
+    std::vector<HadCandidate> hadCandidates;
+    std::vector<CollisionCandidate> collisionCandidates;
+    std::vector<std::vector<CollHadBracket>> collisionBrackets;
+    ColdStore<HadColdFields> hadronsCold;
+    ColdStore<He3ColdFields> he3sCold;
+
+    suite.run("fillParticlesFromTree", "entries", [&]() {
+        he3Candidates.clear();
+        hadCandidates.clear();
+        collisionCandidates.clear();
+        hadronsCold.clear();
+        he3sCold.clear();
+        collisionBrackets = mixing::fillParticlesFromTree(inputCollisionTree, inputCandidateTree, hadCandidates,
+                                                          he3Candidates, collisionCandidates, hadronsCold, he3sCold,
+                                                          histQA, instrumentation, true, is23);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), inputBytes};
+    });
+
+    suite.run("fillParticlesFromTree/asyncRead", "entries", [&]() {
+        he3Candidates.clear();
+        hadCandidates.clear();
+        collisionCandidates.clear();
+        hadronsCold.clear();
+        he3sCold.clear();
+        collisionBrackets = mixing::fillParticlesFromTree(inputCollisionTree, inputCandidateTree, hadCandidates,
+                                                          he3Candidates, collisionCandidates, hadronsCold, he3sCold,
+                                                          histQA, instrumentation, true, is23, BinShard(), nullptr, true);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), inputBytes};
+    });
+
+    // half-precision cold tier (ColdStorage::kPacked), same selections and candidates
+    {
+        std::vector<He3Candidate> packedHe3Candidates;
+        std::vector<HadCandidate> packedHadCandidates;
+        std::vector<CollisionCandidate> packedCollisionCandidates;
+        ColdStore<HadColdFields> packedHadronsCold(ColdStorage::kPacked);
+        ColdStore<He3ColdFields> packedHe3sCold(ColdStorage::kPacked);
+        suite.run("fillParticlesFromTree/packedCold", "entries", [&]() {
+            packedHe3Candidates.clear();
+            packedHadCandidates.clear();
+            packedCollisionCandidates.clear();
+            packedHadronsCold.clear();
+            packedHe3sCold.clear();
+            mixing::fillParticlesFromTree(inputCollisionTree, inputCandidateTree, packedHadCandidates,
+                                          packedHe3Candidates, packedCollisionCandidates, packedHadronsCold, packedHe3sCold,
+                                          histQA, instrumentation, true, is23);
+            return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), inputBytes};
+        });
+        suite.addContext("coldStoreBytes", std::to_string(hadronsCold.getMemoryBytes() + he3sCold.getMemoryBytes()));
+        suite.addContext("packedColdStoreBytes", std::to_string(packedHadronsCold.getMemoryBytes() + packedHe3sCold.getMemoryBytes()));
+    }
+
+    const std::string columnarFileName = std::string(outputRootName) + ".col";
+    if (!columnarInput::convertTrees(inputCollisionTree, inputCandidateTree, columnarFileName))
+        std::cerr << "Conversion to " << columnarFileName << " failed, the columnar benchmark reads no entries" << std::endl;
+    {
+        MappedColumnarFile columnarFile(columnarFileName);
+        suite.run("fillParticlesFromColumns", "entries", [&]() {
+            he3Candidates.clear();
+            hadCandidates.clear();
+            collisionCandidates.clear();
+            hadronsCold.clear();
+            he3sCold.clear();
+            collisionBrackets = mixing::fillParticlesFromColumns(columnarFile, hadCandidates, he3Candidates, collisionCandidates,
+                                                                 hadronsCold, he3sCold, histQA, instrumentation, true, is23);
+            return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), static_cast<double>(columnarFile.getSize())};
+        });
+
+        // one shard of bins per NUMA node (at least two), each ingested by a thread bound to a node and mixed
+        // concurrently by threads bound to the nodes: data on the mixing node, on the next node, or all on the first
+        const int nNodes = numaTopology::getNNodes();
+        const int nShards = std::max(2, nNodes);
+        suite.addContext("numaNodes", std::to_string(nNodes));
+        struct ShardData
+        {
+            std::vector<He3Candidate> fHe3s;
+            std::vector<HadCandidate> fHadrons;
+            std::vector<CollisionCandidate> fCollisions;
+            std::vector<std::vector<CollHadBracket>> fBrackets;
+            ColdStore<HadColdFields> fHadronsCold;
+            ColdStore<He3ColdFields> fHe3sCold;
+            HistogramsQA fHistQA;
+            Instrumentation fInstrumentation;
+        };
+        auto runNumaShards = [&](const char * name, const int ingestionNodeOffset, const bool singleNode) {
+            auto getNode = [&](const int iShard, const int offset) { return singleNode ? 0 : (iShard + offset) % nNodes; };
+            std::vector<std::unique_ptr<ShardData>> shards;
+            std::vector<std::thread> threads;
+            for (int iShard = 0; iShard < nShards; iShard++)
+                shards.emplace_back(new ShardData());
+            for (int iShard = 0; iShard < nShards; iShard++)
+                threads.emplace_back([&, iShard]() {
+                    numaTopology::bindThreadToNode(getNode(iShard, ingestionNodeOffset));
+                    ShardData& shard = *shards[iShard];
+                    shard.fBrackets = mixing::fillParticlesFromColumns(columnarFile, shard.fHadrons, shard.fHe3s, shard.fCollisions,
+                                                                       shard.fHadronsCold, shard.fHe3sCold, shard.fHistQA,
+                                                                       shard.fInstrumentation, true, is23, BinShard(iShard, nShards));
+                });
+            for (auto& thread : threads)
+                thread.join();
+
+            suite.run(name, "pairs", [&]() {
+                std::vector<double> nPairs(nShards, 0.), nBytes(nShards, 0.);
+                std::vector<std::thread> mixingThreads;
+                for (int iShard = 0; iShard < nShards; iShard++)
+                    mixingThreads.emplace_back([&, iShard]() {
+                        numaTopology::bindThreadToNode(getNode(iShard, 0));
+                        ShardData& shard = *shards[iShard];
+                        Mixer shardMixer(shard.fHadrons, shard.fHe3s, shard.fCollisions, shard.fBrackets, shard.fHadronsCold,
+                                         shard.fHe3sCold, mixingDepth, is23);
+                        shardMixer.setSeed(randomSeed + iShard);
+                        const std::string treeName = "MixedTreeBenchmarkShard" + std::to_string(iShard);
+                        TTree outputTree(treeName.c_str(), treeName.c_str());
+                        shardMixer.performEventMixing(&outputTree, shard.fHistQA, shard.fInstrumentation);
+                        nPairs[iShard] = outputTree.GetEntries();
+                        nBytes[iShard] = outputTree.GetTotBytes();
+                    });
+                for (auto& thread : mixingThreads)
+                    thread.join();
+                benchmarkUtils::BenchmarkCounters counters{0., 0.};
+                for (int iShard = 0; iShard < nShards; iShard++)
+                {
+                    counters.items += nPairs[iShard];
+                    counters.bytes += nBytes[iShard];
+                }
+                return counters;
+            });
+        };
+        runNumaShards("Mixer/numaShards/local", 0, false);
+        runNumaShards("Mixer/numaShards/remote", 1, false);
+        runNumaShards("Mixer/numaShards/singleNode", 0, true);
+    }
+    std::remove(columnarFileName.c_str());
+
+    const double candidateBytes = sizeof(He3Candidate) + sizeof(HadCandidate) + sizeof(CollisionCandidate);
+    suite.run("preliminaryCuts", "entries", [&]() {
+        long long nSelected = 0;
+        for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+            nSelected += mixing::preliminaryCuts(rawHe3s[iEntry], rawHadrons[iEntry], rawCollisions[iEntry], is23);
+        if (nSelected < 0)
+            std::cout << "Unexpected selection count" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * candidateBytes};
+    });
+
+    std::vector<uint32_t> clusterSizeWords(nEntries);
+    for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+        clusterSizeWords[iEntry] = rawHe3s[iEntry].fItsClusterSizeHe3;
+    suite.run("ComputeAverageClusterSize", "tracks", [&]() {
+        double clusterSizeSum = 0.;
+        for (const uint32_t clusterSizeWord : clusterSizeWords)
+            clusterSizeSum += ComputeAverageClusterSize(clusterSizeWord);
+        if (clusterSizeSum < 0)
+            std::cout << "Unexpected cluster size" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * sizeof(uint32_t) * 1.};
+    });
+
+    std::vector<float> averageClusterSizes(nEntries), truncatedClusterSizes(nEntries);
+    suite.run("ComputeAverageClusterSizes", "tracks", [&]() {
+        ComputeAverageClusterSizes(clusterSizeWords.data(), clusterSizeWords.size(), averageClusterSizes.data(), truncatedClusterSizes.data());
+        if (nEntries > 0 && averageClusterSizes[0] < 0)
+            std::cout << "Unexpected cluster size" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * (sizeof(uint32_t) + 2 * sizeof(float)) * 1.};
+    });
+
+    // PID expectations, from the parametrisations and from the lookup tables
+    auto runPidExpectations = [&](const char * name) {
+        suite.run(name, "tracks", [&]() {
+            double expectedSum = 0.;
+            for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+            {
+                const float momentumHe3 = std::abs(rawHe3s[iEntry].fPtHe3) * std::cosh(rawHe3s[iEntry].fEtaHe3);
+                expectedSum += BetheBlochHe(momentumHe3) + ComputeExpectedClusterSizeCosLambdaHe(momentumHe3);
+            }
+            if (expectedSum < 0)
+                std::cout << "Unexpected PID expectation" << std::endl;
+            return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * 2. * sizeof(float)};
+        });
+    };
+    runPidExpectations("pidExpectations/analytic");
+    lookupTables::buildLookupTables();
+    suite.addContext("lookupTablesMaxRelativeError", std::to_string(lookupTables::getMaxRelativeError()));
+    runPidExpectations("pidExpectations/lookupTable");
+    lookupTables::gUseLookupTables = false;
+
+    suite.run("getBinIndex", "collisions", [&]() {
+        HistVertexMultiplicity hVertexMultiplicity;
+        long long binSum = 0;
+        for (const auto& collCand : rawCollisions)
+            binSum += hVertexMultiplicity.getBinIndex(collCand.fZVertex, collCand.fCentralityFT0C);
+        if (binSum < 0)
+            std::cout << "Unexpected bin index" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * sizeof(CollisionCandidate) * 1.};
+    });
+
+    const double pairInputBytes = sizeof(He3Candidate) + sizeof(HadCandidate);
+    suite.run("li4InvMass", "pairs", [&]() {
+        double massSum = 0.;
+        for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+            massSum += Li4Candidate::li4InvMass(rawHe3s[iEntry], rawHadrons[iEntry]);
+        if (massSum < 0)
+            std::cout << "Unexpected invariant mass" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * pairInputBytes};
+    });
+
+    // invariant-mass QA filling, with ROOT and with the fixed-bin accumulators of HistogramsQA
+    std::vector<float> invMasses(nEntries);
+    for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+        invMasses[iEntry] = Li4Candidate::li4InvMass(rawHe3s[iEntry], rawHadrons[iEntry]);
+    TH1F hInvMassRoot("hInvMassRoot", "", 600, 3.743, 4.343);
+    hInvMassRoot.SetDirectory(nullptr);
+    suite.run("qaFill/TH1F", "pairs", [&]() {
+        hInvMassRoot.Reset();
+        for (const float invMass : invMasses)
+            hInvMassRoot.Fill(invMass);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * sizeof(float) * 1.};
+    });
+    FixedBinHistogram hInvMassFixedBin(600, 3.743, 4.343);
+    suite.run("qaFill/FixedBinHistogram", "pairs", [&]() {
+        hInvMassFixedBin.reset();
+        for (const float invMass : invMasses)
+            hInvMassFixedBin.fill(invMass);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * sizeof(float) * 1.};
+    });
+    int nDifferentBins = 0;
+    for (int iBin = 0; iBin < hInvMassFixedBin.getNBins() + 2; iBin++)
+        nDifferentBins += hInvMassFixedBin.getBinCount(iBin) != static_cast<uint64_t>(hInvMassRoot.GetBinContent(iBin));
+    suite.addContext("qaFillDifferentBins", std::to_string(nDifferentBins));
+    if (nDifferentBins != 0)
+    {
+        std::cerr << "Validation failed: FixedBinHistogram and TH1F differ in " << nDifferentBins << " bins" << std::endl;
+        validationsPassed = false;
+    }
+
+    suite.run("ComputeKstar", "pairs", [&]() {
+        double kstarSum = 0.;
+        for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+        {
+            const auto& he3Cand = rawHe3s[iEntry];
+            const auto& hadCand = rawHadrons[iEntry];
+            kstarSum += ComputeKstar(std::abs(he3Cand.fPtHe3), he3Cand.fEtaHe3, he3Cand.fPhiHe3, physics::mass::kHelium3,
+                                     std::abs(hadCand.fPtHad), hadCand.fEtaHad, hadCand.fPhiHad, physics::mass::kProton);
+        }
+        if (kstarSum < 0)
+            std::cout << "Unexpected k*" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * pairInputBytes};
+    });
+
+    // closed-form k* from the invariant mass, validated against the boost of ComputeKstar
+    auto kstarClosedForm = [](const He3Candidate& he3Cand, const HadCandidate& hadCand) {
+        return physics::kstar(std::abs(he3Cand.fPtHe3), he3Cand.fEtaHe3, he3Cand.fPhiHe3, physics::mass::kHelium3,
+                              std::abs(hadCand.fPtHad), hadCand.fEtaHad, hadCand.fPhiHad, physics::mass::kProton);
+    };
+    double maxKstarDeviation = 0.;
+    for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+    {
+        const auto& he3Cand = rawHe3s[iEntry];
+        const auto& hadCand = rawHadrons[iEntry];
+        const double kstar = ComputeKstar(std::abs(he3Cand.fPtHe3), he3Cand.fEtaHe3, he3Cand.fPhiHe3, physics::mass::kHelium3,
+                                          std::abs(hadCand.fPtHad), hadCand.fEtaHad, hadCand.fPhiHad, physics::mass::kProton);
+        maxKstarDeviation = std::max(maxKstarDeviation, std::abs(kstarClosedForm(he3Cand, hadCand) - kstar));
+    }
+    std::cout << "Closed-form k*: largest deviation from ComputeKstar " << maxKstarDeviation << " GeV/c" << std::endl;
+    suite.addContext("kstarClosedFormMaxDeviation", std::to_string(maxKstarDeviation));
+
+    suite.run("kstarClosedForm", "pairs", [&]() {
+        double kstarSum = 0.;
+        for (long long iEntry = 0; iEntry < nEntries; iEntry++)
+            kstarSum += kstarClosedForm(rawHe3s[iEntry], rawHadrons[iEntry]);
+        if (kstarSum < 0)
+            std::cout << "Unexpected k*" << std::endl;
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(nEntries), nEntries * pairInputBytes};
+    });
+
+    Mixer mixer(hadCandidates, he3Candidates, collisionCandidates, collisionBrackets, hadronsCold, he3sCold, mixingDepth, is23);
+
+    suite.run("Mixer::performEventMixing", "pairs", [&]() {
+        mixer.setSeed(randomSeed);
+        mixer.setHadronProcessTimes({});
+        TTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+        mixer.performEventMixing(&outputTree, histQA, instrumentation);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(outputTree.GetEntries()),
+                                                 static_cast<double>(outputTree.GetTotBytes())};
+    });
+
+    // steady state of the mixing loop and of the pair output: a first pass over all the He3s brings the scratch arena
+    // and the pair batches to their high-water marks, a second pass with the same seed must not allocate. The
+    // allocations of the setup of a pass (output branches, writer) are measured by a pass over no He3, the ones of the
+    // baskets of the output tree are counted apart by AllocationCountingTree.
+    long long steadyStateAllocations = -1;
+    if (kCountsHeapAllocations)
+    {
+        auto countPassAllocations = [&](const size_t firstHe3) {
+            mixer.setSeed(randomSeed);
+            mixer.setHadronProcessTimes({});
+            mixer.setFirstHe3(firstHe3);
+            AllocationCountingTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+            const long long allocationsBefore = gNHeapAllocations.load();
+            mixer.performEventMixing(&outputTree, histQA, instrumentation);
+            return gNHeapAllocations.load() - allocationsBefore - outputTree.getFillAllocations();
+        };
+        countPassAllocations(0);
+        const long long setupAllocations = countPassAllocations(he3Candidates.size());
+        steadyStateAllocations = countPassAllocations(0) - setupAllocations;
+        mixer.setFirstHe3(0);
+        std::cout << "Mixing loop and pair output: " << steadyStateAllocations << " heap allocations after warm-up"
+                  << " (setup of a pass " << setupAllocations << "), scratch arena high-water mark "
+                  << mixer.getScratchArena().getHighWaterMark() << " bytes" << std::endl;
+        if (steadyStateAllocations != 0)
+        {
+            std::cerr << "Validation failed: the steady-state mixing loop allocated " << steadyStateAllocations
+                      << " times, expected 0" << std::endl;
+            validationsPassed = false;
+        }
+    }
+    else
+    {
+        std::cout << "Mixing loop: heap allocations not counted (standalone executable only)" << std::endl;
+    }
+    suite.addContext("mixingSteadyStateAllocations", std::to_string(steadyStateAllocations));
+
+    mixer.setAsyncOutput(true);
+    suite.run("Mixer::performEventMixing/asyncOutput", "pairs", [&]() {
+        mixer.setSeed(randomSeed);
+        mixer.setHadronProcessTimes({});
+        TTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+        mixer.performEventMixing(&outputTree, histQA, instrumentation);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(outputTree.GetEntries()),
+                                                 static_cast<double>(outputTree.GetTotBytes())};
+    });
+    mixer.setAsyncOutput(false);
+
+    // unlike-sign pairs only: the like-sign half of each bracket is not visited
+    mixer.setPairCharge(mixing::kUnlikeSign);
+    suite.run("Mixer::performEventMixing/unlikeSign", "pairs", [&]() {
+        mixer.setSeed(randomSeed);
+        mixer.setHadronProcessTimes({});
+        TTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+        mixer.performEventMixing(&outputTree, histQA, instrumentation);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(outputTree.GetEntries()),
+                                                 static_cast<double>(outputTree.GetTotBytes())};
+    });
+    mixer.setPairCharge(mixing::kAllPairs);
+
+    // k* window: all the hadrons tested (reference) and only the ones in the compatible rapidity window
+    const float kstarMax = 0.2;
+    for (const bool pruning : {false, true})
+    {
+        mixer.setKstarMax(kstarMax, pruning);
+        suite.run(pruning ? "Mixer::performEventMixing/kstarPruned" : "Mixer::performEventMixing/kstarBruteForce", "pairs", [&]() {
+            mixer.setSeed(randomSeed);
+            mixer.setHadronProcessTimes({});
+            TTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+            mixer.performEventMixing(&outputTree, histQA, instrumentation);
+            return benchmarkUtils::BenchmarkCounters{static_cast<double>(outputTree.GetEntries()),
+                                                     static_cast<double>(outputTree.GetTotBytes())};
+        });
+    }
+
+    // the pruned pairs are compared to the brute-force ones pair by pair (He3 and hadron indices), for the event mixing
+    // and for the pairings with the own collision (rotated and same-event): a mismatch is a pair found by only one of
+    // the two modes
+    auto collectKstarPairs = [&](const int strategy, const bool pruning) {
+        mixer.setKstarMax(kstarMax, pruning);
+        mixer.setSeed(randomSeed);
+        mixer.setHadronProcessTimes({});
+        HistogramsQA pairsHistQA;
+        Instrumentation pairsInstrumentation;
+        PairGenerator generator(mixer, strategy, pairsHistQA, pairsInstrumentation);
+        std::vector<std::pair<int, int>> pairs;
+        std::vector<MixedPair> batch;
+        while (generator.next(batch))
+            for (const MixedPair& pair : batch)
+                pairs.emplace_back(pair.fHe3Index, pair.fHadIndex);
+        std::sort(pairs.begin(), pairs.end());
+        return pairs;
+    };
+    for (const int strategy : {mixing::kEvent, mixing::kRotation, mixing::kSameEvent})
+    {
+        const auto bruteForcePairs = collectKstarPairs(strategy, false);
+        const auto prunedPairs = collectKstarPairs(strategy, true);
+        std::vector<std::pair<int, int>> mismatches;
+        std::set_symmetric_difference(bruteForcePairs.begin(), bruteForcePairs.end(), prunedPairs.begin(), prunedPairs.end(),
+                                      std::back_inserter(mismatches));
+        const char * label = strategy == mixing::kEvent ? "event mixing" : strategy == mixing::kRotation ? "rotation" : "own collision";
+        std::cout << "k* < " << kstarMax << " GeV/c, " << label << ": " << bruteForcePairs.size() << " pairs by brute force, "
+                  << prunedPairs.size() << " with pruning, " << mismatches.size() << " mismatches" << std::endl;
+        const char * contextName = strategy == mixing::kEvent ? "kstarPruningMismatches" :
+                                   strategy == mixing::kRotation ? "kstarPruningMismatchesRotation" : "kstarPruningMismatchesOwnCollision";
+        suite.addContext(contextName, std::to_string(mismatches.size()));
+        if (!mismatches.empty())
+        {
+            std::cerr << "Validation failed: k* pruning (" << label << ") differs from brute force in "
+                      << mismatches.size() << " pairs" << std::endl;
+            validationsPassed = false;
+        }
+    }
+    mixer.setKstarMax(0.);
+
+    suite.run("Mixer::performAngleMixing", "pairs", [&]() {
+        mixer.setSeed(randomSeed);
+        TTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+        mixer.performAngleMixing(&outputTree, histQA, instrumentation);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(outputTree.GetEntries()),
+                                                 static_cast<double>(outputTree.GetTotBytes())};
+    });
+
+    // same pairs as Mixer::performEventMixing, pulled in batches without an output tree
+    suite.run("PairGenerator/eventMixing", "pairs", [&]() {
+        mixer.setSeed(randomSeed);
+        mixer.setHadronProcessTimes({});
+        PairGenerator generator(mixer, mixing::kEvent, histQA, instrumentation);
+        std::vector<MixedPair> batch;
+        double nPairs = 0.;
+        while (generator.next(batch))
+            nPairs += batch.size();
+        return benchmarkUtils::BenchmarkCounters{nPairs, nPairs * sizeof(MixedPair)};
+    });
+
+    suite.run("Mixer::performSameEvent", "pairs", [&]() {
+        TTree outputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+        mixer.performSameEvent(&outputTree, histQA, instrumentation);
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(outputTree.GetEntries()),
+                                                 static_cast<double>(outputTree.GetTotBytes())};
+    });
+
+    // event and angle mixing of the same candidates, run concurrently by two Mixers sharing them
+    HistogramsQA angleHistQA;
+    Instrumentation angleInstrumentation;
+    suite.run("Mixer/concurrentJobs", "pairs", [&]() {
+        Mixer eventMixer(hadCandidates, he3Candidates, collisionCandidates, collisionBrackets, hadronsCold, he3sCold, mixingDepth, is23);
+        Mixer angleMixer(hadCandidates, he3Candidates, collisionCandidates, collisionBrackets, hadronsCold, he3sCold, mixingDepth, is23);
+        eventMixer.setSeed(randomSeed);
+        TTree eventOutputTree("MixedTreeBenchmark", "MixedTreeBenchmark");
+        TTree angleOutputTree("MixedTreeBenchmarkAngle", "MixedTreeBenchmarkAngle");
+        std::thread angleJob([&]() { angleMixer.performAngleMixing(&angleOutputTree, angleHistQA, angleInstrumentation); });
+        eventMixer.performEventMixing(&eventOutputTree, histQA, instrumentation);
+        angleJob.join();
+        return benchmarkUtils::BenchmarkCounters{static_cast<double>(eventOutputTree.GetEntries() + angleOutputTree.GetEntries()),
+                                                 static_cast<double>(eventOutputTree.GetTotBytes() + angleOutputTree.GetTotBytes())};
+    });
+
+    // output writing: same number of pairs as input entries, pairing each hadron with a He3 from the store
+    suite.run("outputWriting", "pairs", [&]() {
+        auto outputFile = TFile::Open(outputRootName, "RECREATE");
+        auto outputTree = new TTree("MixedTree", "MixedTree");
+        Li4Candidate li4Candidate;
+        li4Candidate.setBranch(outputTree);
+        const size_t nHe3s = he3Candidates.size();
+        for (size_t iHad = 0; iHad < hadCandidates.size() && nHe3s > 0; iHad++)
+        {
+            const He3Candidate& he3Cand = he3Candidates[iHad % nHe3s];
+            li4Candidate.setHe3(he3Cand);
+            li4Candidate.setHe3Cold(he3sCold.get(he3Cand.fColdIndex));
+            li4Candidate.setHad(hadCandidates[iHad]);
+            li4Candidate.setHadCold(hadronsCold.get(hadCandidates[iHad].fColdIndex));
+            outputTree->Fill();
+        }
+        const double nPairs = outputTree->GetEntries();
+        outputFile->cd();
+        outputTree->Write();
+        outputFile->Close();
+        const double bytesWritten = outputFile->GetBytesWritten();
+        delete outputFile;
+        return benchmarkUtils::BenchmarkCounters{nPairs, bytesWritten};
+    });
+
+    suite.print();
+    suite.writeJson(outputJsonName);
+
+    delete inputCandidateTree;
+    delete inputCollisionTree;
+    return validationsPassed;
+}
+
+#ifdef EVENTMIXING_STANDALONE
+int main(int argc, char ** argv)
+{
+    gROOT->SetBatch(true);
+    const int nCollisions = argc > 1 ? std::atoi(argv[1]) : 20000;
+    const float meanMultiplicity = argc > 2 ? std::atof(argv[2]) : 5.;
+    const int mixingDepth = argc > 3 ? std::atoi(argv[3]) : 4;
+    const double minTime = argc > 4 ? std::atof(argv[4]) : 1.;
+    const char * outputJsonName = argc > 5 ? argv[5] : "benchmarkLi4.json";
+    const char * outputRootName = argc > 6 ? argv[6] : "benchmarkLi4Output.root";
+    const char * version = argc > 7 ? argv[7] : "dev";
+    return benchmarkLi4(nCollisions, meanMultiplicity, mixingDepth, minTime, outputJsonName, outputRootName, version) ? 0 : 1;
+}
+#endif
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <string>
+
+#include <TFile.h>
+#include <TROOT.h>
+#include <TTree.h>
+
+#include "../include/li4/columnarInput.hh"
+
+/**
+ * Convert the merged mixing input (candidate and collision trees) to a columnar file that mixingLi4 maps in
+ * memory (columnarInputFileName in the configuration).
+ * @param collisionIndexBranch Integer branch of the collision tree identifying the collision (optional).
+ * @return false if an input tree is missing or the output could not be written
+*/
+bool convertToColumnar(const char * candidatesFileName, const char * collisionsFileName, const char * outputFileName,
+                       const char * collisionIndexBranch = "",
+                       const char * candidatesTreeName = "O2he3hadtable", const char * collisionsTreeName = "O2he3hadmult")
+{
+    TFile * inputCandsFile = TFile::Open(candidatesFileName);
+    TFile * inputCollsFile = TFile::Open(collisionsFileName);
+    if (!inputCandsFile || !inputCollsFile)
+    {
+        std::cerr << "Cannot open the input files." << std::endl;
+        return false;
+    }
+    TTree * inputCandidateTree = (TTree *)inputCandsFile->Get(candidatesTreeName);
+    TTree * inputCollisionTree = (TTree *)inputCollsFile->Get(collisionsTreeName);
+
+    bool converted = false;
+    if (!inputCandidateTree || !inputCollisionTree)
+    {
+        std::cerr << "Missing input tree " << (inputCandidateTree ? collisionsTreeName : candidatesTreeName) << "." << std::endl;
+    }
+    else
+    {
+        const std::string indexBranch = collisionIndexBranch;
+        converted = columnarInput::convertTrees(inputCollisionTree, inputCandidateTree, outputFileName,
+                                                indexBranch.empty() ? nullptr : indexBranch.c_str());
+    }
+
+    inputCandsFile->Close();
+    inputCollsFile->Close();
+    return converted;
+}
+
+#ifdef EVENTMIXING_STANDALONE
+int main(int argc, char ** argv)
+{
+    gROOT->SetBatch(true);
+    if (argc < 4)
+    {
+        std::cerr << "Usage: convertToColumnar <inputCands.root> <inputColls.root> <output.col> [collisionIndexBranch]" << std::endl;
+        return 1;
+    }
+    return convertToColumnar(argv[1], argv[2], argv[3], argc > 4 ? argv[4] : "") ? 0 : 1;
+}
+#endif
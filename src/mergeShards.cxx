@@ -0,0 +1,86 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <TChain.h>
+#include <TFile.h>
+#include <TNamed.h>
+#include <TROOT.h>
+#include <TTree.h>
+
+#include "../include/core/instrumentation.hh"
+#include "../include/li4/histograms.hh"
+
+/**
+ * Merge the partial outputs of sharded mixingLi4 jobs.
+ * The MixedTree trees are concatenated without decompression, the QA histograms are summed and their
+ * comparison canvases are redrawn, the instrumentation counters and stage times are summed.
+ * @param outputFileName Name of the merged output file.
+ * @param inputFileNames Partial outputs (e.g. <name>_shard0of8.root ... <name>_shard7of8.root).
+ * @return false if a partial output could not be read, in which case nothing is written.
+*/
+bool mergeShards(const char * outputFileName, const std::vector<std::string>& inputFileNames,
+                 const char * treeName = "MixedTree")
+{
+    HistogramsQA histQA;
+    Instrumentation instrumentation;
+
+    TChain chain(treeName);
+    for (const auto& inputFileName : inputFileNames)
+    {
+        TFile * inputFile = TFile::Open(inputFileName.c_str(), "READ");
+        if (!inputFile || inputFile->IsZombie())
+        {
+            std::cerr << "Could not open partial output: " << inputFileName << std::endl;
+            return false;
+        }
+
+        TNamed * shardInfo = (TNamed *)inputFile->Get("BinShard");
+        std::cout << "Merging " << inputFileName << " (" << (shardInfo ? shardInfo->GetTitle() : "unsharded") << ")" << std::endl;
+
+        TDirectory * qaDirectory = inputFile->GetDirectory("HistogramsQA");
+        if (qaDirectory)
+            histQA.addHistograms(qaDirectory);
+        TDirectory * instrumentationDirectory = inputFile->GetDirectory("Instrumentation");
+        if (instrumentationDirectory)
+            instrumentation.addSummary(instrumentationDirectory);
+
+        inputFile->Close();
+        delete inputFile;
+        chain.Add(inputFileName.c_str());
+    }
+
+    TFile * outputFile = TFile::Open(outputFileName, "RECREATE");
+    if (!outputFile || outputFile->IsZombie())
+    {
+        std::cerr << "Could not create merged output: " << outputFileName << std::endl;
+        return false;
+    }
+    outputFile->cd();
+    TTree * outputTree = chain.CloneTree(-1, "fast");
+    outputTree->Write();
+
+    auto qaDirectory = outputFile->mkdir("HistogramsQA");
+    histQA.saveHistograms(qaDirectory);
+    auto instrumentationDirectory = outputFile->mkdir("Instrumentation");
+    instrumentation.saveSummary(instrumentationDirectory);
+
+    instrumentation.printSummary();
+    std::cout << "Merged " << inputFileNames.size() << " partial outputs into " << outputFileName << std::endl;
+    outputFile->Close();
+    return true;
+}
+
+#ifdef EVENTMIXING_STANDALONE
+int main(int argc, char ** argv)
+{
+    gROOT->SetBatch(true);
+    if (argc < 3)
+    {
+        std::cerr << "Usage: mergeShards <output.root> <partial1.root> [partial2.root ...]" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> inputFileNames(argv + 2, argv + argc);
+    return mergeShards(argv[1], inputFileNames) ? 0 : 1;
+}
+#endif
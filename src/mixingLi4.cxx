@@ -1,16 +1,34 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <TString.h>
 #include <TTree.h>
 #include <TFile.h>
 #include <TStopwatch.h>
+#include <TROOT.h>
+#include <TNamed.h>
 
 #include <TRandom3.h>
 
 #include "../include/core/treeUtils.hh"
+#include "../include/core/instrumentation.hh"
+#include "../include/core/sharding.hh"
+#include "../include/core/parallelUtils.hh"
+#include "../include/core/binMerging.hh"
+#include "../include/core/coldStore.hh"
+#include "../include/core/numaTopology.hh"
+#include "../include/core/columnarFile.hh"
+#include "../include/core/memoryAccounting.hh"
+#include "../include/li4/checkpoint.hh"
+#include "../include/li4/memoryBudget.hh"
 #include "../include/li4/li4candidates.hh"
+#include "../include/li4/columnarInput.hh"
 #include "../include/li4/mixing.hh"
+#include "../include/li4/mixingPool.hh"
 
 #include <yaml-cpp/yaml.h>
 
@@ -30,10 +48,81 @@ void mergeTrees(const char * inputFileName,
     inputCollsFile->Close();
 }
 
-void mixingLi4(const char * configFileName = "config/configMixingLi4.yml")
+/**
+ * Build the shard of bins processed by this job, from the command line (if shardCount > 0) or from the configuration
+*/
+BinShard configureShard(const YAML::Node& config, const int shardIndex, const int shardCount)
+{
+    if (shardCount > 0)
+        return BinShard(shardIndex, shardCount);
+    if (config["shardBins"])
+        return BinShard(config["shardBins"].as<std::vector<int>>());
+    if (config["shardCount"])
+        return BinShard(config["shardIndex"] ? config["shardIndex"].as<int>() : 0, config["shardCount"].as<int>());
+    return BinShard();
+}
+
+/**
+ * Output name of a partial (sharded) output: <name>_<shard label>.root
+*/
+std::string shardOutputFileName(const std::string& outputFileName, const BinShard& shard)
+{
+    if (!shard.isSharded())
+        return outputFileName;
+    const size_t extension = outputFileName.rfind(".root");
+    const std::string stem = extension == std::string::npos ? outputFileName : outputFileName.substr(0, extension);
+    return stem + "_" + shard.getLabel() + ".root";
+}
+
+/**
+ * One mixing of the loaded candidates, with its own strategy, depth, seed and output file
+*/
+struct MixingJob
+{
+    std::string fName;
+    int fMixingStrategy;
+    int fMixingDepth;
+    int fRandomSeed;
+    std::string fOutputFileName;
+};
+
+/**
+ * Mixing jobs of the configuration: one per entry of mixingJobs, with the top-level mixingStrategy, mixingDepth and
+ * randomSeed as defaults and <outputFileName stem>_<name>.root as output, or a single job with the top-level values.
+ * With sameEvent, a same-event job writing <outputFileName stem>_same.root is added.
+*/
+std::vector<MixingJob> configureJobs(const YAML::Node& config)
+{
+    const MixingJob defaultJob{"", config["mixingStrategy"].as<int>(), config["mixingDepth"].as<int>(),
+                               config["randomSeed"].as<int>(), config["outputFileName"].as<std::string>()};
+    const size_t extension = defaultJob.fOutputFileName.rfind(".root");
+    const std::string stem = extension == std::string::npos ? defaultJob.fOutputFileName : defaultJob.fOutputFileName.substr(0, extension);
+    std::vector<MixingJob> jobs;
+    if (!config["mixingJobs"])
+        jobs.push_back(defaultJob);
+    for (const YAML::Node& jobConfig : config["mixingJobs"])
+    {
+        MixingJob job = defaultJob;
+        job.fName = jobConfig["name"] ? jobConfig["name"].as<std::string>() : "job" + std::to_string(jobs.size());
+        if (jobConfig["mixingStrategy"])
+            job.fMixingStrategy = jobConfig["mixingStrategy"].as<int>();
+        if (jobConfig["mixingDepth"])
+            job.fMixingDepth = jobConfig["mixingDepth"].as<int>();
+        if (jobConfig["randomSeed"])
+            job.fRandomSeed = jobConfig["randomSeed"].as<int>();
+        job.fOutputFileName = jobConfig["outputFileName"] ? jobConfig["outputFileName"].as<std::string>() : stem + "_" + job.fName + ".root";
+        jobs.push_back(job);
+    }
+    if (config["sameEvent"] && config["sameEvent"].as<bool>())
+        jobs.push_back({"same", mixing::MixingStrategy::kSameEvent, 0, defaultJob.fRandomSeed, stem + "_same.root"});
+    return jobs;
+}
+
+bool mixingLi4(const char * configFileName = "config/configMixingLi4.yml", const int shardIndex = 0, const int shardCount = -1)
 {   
     TStopwatch timer;
     HistogramsQA histQA;
+    Instrumentation instrumentation;
 
     const char * candidatesFileName = "/home/galucia/EventMixing/output/inputCands.root";
     const char * collisionsFileName = "/home/galucia/EventMixing/output/inputColls.root";
@@ -42,54 +131,380 @@ void mixingLi4(const char * configFileName = "config/configMixingLi4.yml")
 
     YAML::Node config = YAML::LoadFile(configFileName);
     const bool doMerge = config["doMerge"].as<bool>();
-    const int mixingStrategy = config["mixingStrategy"].as<int>();
-    const int mixingDepth = config["mixingDepth"].as<int>();
     const bool is23 = config["is23"].as<bool>();
     const bool applyCuts = config["applyCuts"].as<bool>();
-    const int randomSeed = config["randomSeed"].as<int>();
-    gRandom->SetSeed(randomSeed);
+    const std::vector<MixingJob> jobs = configureJobs(config);
+    mixing::setApplyITSCuts(config["itsCuts"] ? config["itsCuts"].as<bool>() : false);
+    if (config["pidLookupTables"] && config["pidLookupTables"].as<bool>()) {
+        lookupTables::buildLookupTables();
+        std::cout << "PID lookup tables built, largest relative deviation from the parametrisations: " 
+                  << lookupTables::getMaxRelativeError() << std::endl;
+    }
+    const BinShard shard = configureShard(config, shardIndex, shardCount);
+    const HistVertexMultiplicity binning;
+    if (!shard.isValid(binning.mZetaBins * binning.mMultBins + 1)) {
+        std::cerr << "Invalid shard " << shard.getLabel() << ": shardIndex must be in [0, shardCount) and shardBins in [0, "
+                  << binning.mZetaBins * binning.mMultBins + 1 << ")." << std::endl;
+        return false;
+    }
+    parallelUtils::setNThreads(config["nThreads"] ? config["nThreads"].as<int>() : 1);
+    ColdStorage coldStorage = static_cast<ColdStorage>(config["coldStorage"] ? config["coldStorage"].as<int>() : 0);
+    const std::string collisionIndexBranch = config["collisionIndexBranch"] ? config["collisionIndexBranch"].as<std::string>() : "";
+    const bool numaBinding = config["numaBinding"] ? config["numaBinding"].as<bool>() : false;
+    const bool asyncPipeline = config["asyncPipeline"] ? config["asyncPipeline"].as<bool>() : false;
+    const int pipelineBatchSize = config["pipelineBatchSize"] ? config["pipelineBatchSize"].as<int>() : 4096;
+    const int pipelineDepth = config["pipelineDepth"] ? config["pipelineDepth"].as<int>() : 4;
+    const std::string columnarInputFileName = config["columnarInputFileName"] ? config["columnarInputFileName"].as<std::string>() : "";
+    const bool incremental = config["incremental"] ? config["incremental"].as<bool>() : false;
+    const int minPoolCollisions = config["minPoolCollisions"] ? config["minPoolCollisions"].as<int>() : 0;
+    const int pairCharge = config["pairCharge"] ? config["pairCharge"].as<int>() : mixing::PairCharge::kAllPairs;
+    const float kstarMax = config["kstarMax"] ? config["kstarMax"].as<float>() : 0.;
+    const bool kstarPruning = config["kstarPruning"] ? config["kstarPruning"].as<bool>() : true;
+    const double checkpointInterval = config["checkpointInterval"] ? config["checkpointInterval"].as<double>() : 0.;
+    const bool resume = config["resume"] ? config["resume"].as<bool>() : false;
+    const size_t memoryBudgetBytes = config["memoryBudget"] ? config["memoryBudget"].as<double>() * memoryAccounting::kMegaByte : 0;
+    const std::string poolFileName = config["poolFileName"] ? shardOutputFileName(config["poolFileName"].as<std::string>(), shard) : "";
+    // several jobs share the candidates read-only and run in parallel, unless the cold fields are read back from disk
+    bool parallelJobs = jobs.size() > 1 && coldStorage != ColdStorage::kDisk;
+    if (asyncPipeline || parallelJobs) {
+        ROOT::EnableThreadSafety();
+    }
+    if (coldStorage != ColdStorage::kMemory && coldStorage != ColdStorage::kDisk && coldStorage != ColdStorage::kPacked) {
+        std::cout << "Unknown cold storage mode." << std::endl;
+        return false;
+    }
+    if (pipelineBatchSize < 1 || pipelineDepth < 2) {
+        std::cerr << "The asynchronous pipeline needs pipelineBatchSize >= 1 and pipelineDepth >= 2." << std::endl;
+        return false;
+    }
+    if (incremental && (poolFileName.empty() || coldStorage == ColdStorage::kDisk)) {
+        std::cerr << "Incremental mixing requires poolFileName and coldStorage: 0." << std::endl;
+        return false;
+    }
+    if (minPoolCollisions > 0 && shard.isSharded()) {
+        std::cerr << "Adaptive binning (minPoolCollisions) needs all the bins and is not supported in sharded mode." << std::endl;
+        return false;
+    }
+    // the pool keeps the hadron reuse counts of one mixing, the same-event jobs do not use them
+    auto isMixingJob = [](const MixingJob& job) { return job.fMixingStrategy != mixing::MixingStrategy::kSameEvent; };
+    if (std::count_if(jobs.begin(), jobs.end(), isMixingJob) > 1 && !poolFileName.empty()) {
+        std::cerr << "The mixing pool (poolFileName) is not supported with several mixingJobs." << std::endl;
+        return false;
+    }
+    if (pairCharge != mixing::PairCharge::kAllPairs && pairCharge != mixing::PairCharge::kLikeSign && 
+        pairCharge != mixing::PairCharge::kUnlikeSign) {
+        std::cout << "Unknown pair charge combination." << std::endl;
+        return false;
+    }
+    for (const MixingJob& job : jobs) {
+        if (job.fMixingStrategy != mixing::MixingStrategy::kEvent && job.fMixingStrategy != mixing::MixingStrategy::kRotation &&
+            job.fMixingStrategy != mixing::MixingStrategy::kSameEvent) {
+            std::cout << "Unknown mixing strategy." << std::endl;
+            return false;
+        }
+    }
 
-    if (doMerge) {
+    // one shard per NUMA node: the process is bound before it starts any thread, so that its candidates, brackets and
+    // outputs are allocated on the node whose CPUs mix them
+    // an unsharded run would be pinned to the CPUs of node 0 only, it is left unbound
+    if (numaBinding && !shard.isSharded()) {
+        std::cerr << "numaBinding is ignored without sharding: the whole input would run on the CPUs of one node." << std::endl;
+    } else if (numaBinding) {
+        const int nNodes = numaTopology::getNNodes();
+        const int node = shard.getShardIndex() % nNodes;
+        if (numaTopology::bindThreadToNode(node)) {
+            std::cout << "Bound to NUMA node " << node << " of " << nNodes << std::endl;
+            // the parallel passes use the CPUs of the node
+            if (!config["nThreads"] || config["nThreads"].as<int>() <= 0) {
+                parallelUtils::setNThreads(numaTopology::getNodes()[node].fCpus.size());
+            }
+        }
+    }
+
+    if (shard.isSharded()) {
+        std::cout << "Processing bins of " << shard.getLabel() << std::endl;
+        if (doMerge) {
+            std::cerr << "doMerge is not supported in sharded mode: merge the input once before launching the shards." << std::endl;
+            return false;
+        }
+    }
+
+    if (doMerge && columnarInputFileName.empty()) {
         std::string inputFileName = config["inputFileName"].as<std::string>();
         mergeTrees(inputFileName.c_str(), candidatesFileName, collisionsFileName, candidatesTreeName, collisionsTreeName);
     }
 
-    TFile *inputCandsFile = TFile::Open(candidatesFileName);
-    TTree *inputCandidateTree = (TTree *)inputCandsFile->Get(candidatesTreeName);
-    TFile *inputCollsFile = TFile::Open(collisionsFileName);
-    TTree *inputCollisionTree = (TTree *)inputCollsFile->Get(collisionsTreeName);
-
     std::vector<He3Candidate> he3Candidates;
     std::vector<HadCandidate> hadCandidates;
     std::vector<CollisionCandidate> collisionCandidates;
-    auto collisionBrackets = mixing::fillParticlesFromTree(inputCollisionTree, inputCandidateTree, hadCandidates,
-                                                           he3Candidates, collisionCandidates, histQA, applyCuts);
+    ColdStore<HadColdFields> hadronsCold(coldStorage);
+    ColdStore<He3ColdFields> he3sCold(coldStorage);
 
-    inputCandsFile->Close();
-    inputCollsFile->Close();
+    // incremental mixing: the pool of the previous runs is mixed again only as partner of the new He3s
+    HistVertexMultiplicity hVertexMultiplicity;
+    std::vector<std::vector<CollHadBracket>> poolBrackets(hVertexMultiplicity.mZetaBins * hVertexMultiplicity.mMultBins + 1);
+    std::vector<int> hadronProcessTimes;
+    if (incremental) {
+        TFile * poolFile = TFile::Open(poolFileName.c_str());
+        if (poolFile && !poolFile->IsZombie()) {
+            mixingPool::loadPool(poolFile, hadCandidates, he3Candidates, collisionCandidates, hadronsCold, he3sCold, hadronProcessTimes);
+            mixing::appendBrackets(hadCandidates, 0, collisionCandidates, 0, poolBrackets, &hadronProcessTimes);
+            poolFile->Close();
+        } else {
+            std::cout << "No mixing pool in " << poolFileName << ", starting a new one." << std::endl;
+        }
+    }
+    const size_t nPoolHe3s = he3Candidates.size();
+
+    // memory budget: the footprint is projected from the number of input entries before reading them, the cold
+    // storage and the output baskets are adapted if it exceeds the budget (see memoryBudget)
+    size_t basketBytes = memoryBudget::kDefaultBasketBytes;
+    auto applyMemoryBudget = [&](const size_t nInputEntries) {
+        if (memoryBudgetBytes == 0) {
+            return;
+        }
+        size_t nEntries = nInputEntries;
+        if (shard.isSharded()) {
+            const int nBins = hVertexMultiplicity.mZetaBins * hVertexMultiplicity.mMultBins + 1;
+            int nShardBins = 0;
+            for (int iBin = 0; iBin < nBins; iBin++) {
+                nShardBins += shard.contains(iBin);
+            }
+            nEntries = nInputEntries * nShardBins / nBins;
+        }
+        const memoryBudget::Plan plan = memoryBudget::plan(nEntries + hadCandidates.size(), coldStorage, jobs.size(),
+                                                           memoryBudgetBytes, hadronsCold.size() == 0 && !incremental);
+        basketBytes = plan.fBasketBytes;
+        if (plan.fColdStorage != coldStorage) {
+            // both stores change mode or none does
+            const bool hadronsChanged = hadronsCold.setStorage(plan.fColdStorage);
+            const bool he3sChanged = he3sCold.setStorage(plan.fColdStorage);
+            if (hadronsChanged && he3sChanged) {
+                coldStorage = plan.fColdStorage;
+                parallelJobs = false;
+            } else {
+                hadronsCold.setStorage(coldStorage);
+                he3sCold.setStorage(coldStorage);
+                std::cerr << "Memory budget: the cold storage cannot be changed after candidates were stored." << std::endl;
+            }
+        }
+    };
+
+    // the columnar input (or, in kDisk mode, the candidate tree) stays open until the pairs are written
+    MappedColumnarFile columnarInputFile;
+    TFile *inputCandsFile = nullptr;
+    std::vector<std::vector<CollHadBracket>> collisionBrackets;
+    if (!columnarInputFileName.empty()) {
+        if (!columnarInputFile.open(columnarInputFileName)) {
+            return false;
+        }
+        applyMemoryBudget(columnarInputFile.getNRows());
+        collisionBrackets = mixing::fillParticlesFromColumns(columnarInputFile, hadCandidates, he3Candidates, collisionCandidates,
+                                                             hadronsCold, he3sCold, histQA, instrumentation, applyCuts, false, shard);
+        if (collisionBrackets.empty()) {
+            return false;
+        }
+    } else {
+        inputCandsFile = TFile::Open(candidatesFileName);
+        TTree *inputCandidateTree = (TTree *)inputCandsFile->Get(candidatesTreeName);
+        TFile *inputCollsFile = TFile::Open(collisionsFileName);
+        TTree *inputCollisionTree = (TTree *)inputCollsFile->Get(collisionsTreeName);
+        applyMemoryBudget(inputCandidateTree->GetEntries());
+
+        collisionBrackets = mixing::fillParticlesFromTree(inputCollisionTree, inputCandidateTree, hadCandidates,
+                                                          he3Candidates, collisionCandidates, hadronsCold, he3sCold,
+                                                          histQA, instrumentation, applyCuts,
+                                                          false, shard, collisionIndexBranch.empty() ? nullptr : collisionIndexBranch.c_str(),
+                                                          asyncPipeline);
+
+        if (coldStorage != ColdStorage::kDisk) {
+            inputCandsFile->Close();
+        }
+        inputCollsFile->Close();
+    }
+    for (size_t iBin = 0; iBin < collisionBrackets.size(); iBin++) {
+        collisionBrackets[iBin].insert(collisionBrackets[iBin].begin(), poolBrackets[iBin].begin(), poolBrackets[iBin].end());
+    }
 
-    std::string outputFileName = config["outputFileName"].as<std::string>();
-    auto outputFile = TFile::Open(outputFileName.c_str(), "RECREATE"); 
-    auto outputTree = new TTree("MixedTree", "MixedTree");
+    // adaptive binning: neighbouring sparse bins are merged into pools of at least minPoolCollisions collisions
+    BinMerging binMerging;
+    if (minPoolCollisions > 0) {
+        ScopedTimer binningTimer(instrumentation, instrumentation::kBinning);
+        std::vector<int> binCounts(collisionBrackets.size());
+        for (size_t iBin = 0; iBin < collisionBrackets.size(); iBin++) {
+            binCounts[iBin] = collisionBrackets[iBin].size();
+        }
+        binMerging.build(binCounts, minPoolCollisions);
+        collisionBrackets = binMerging.mergeBrackets(collisionBrackets);
+        binMerging.printSummary();
+    }
+
+    // one output file, QA and instrumentation per job, starting from the ones of the input reading
+    // the invariant-mass (BeforeEM) histograms of a same-event job are those of its written pairs, filled by the job
+    const int nJobs = jobs.size();
+    std::vector<std::unique_ptr<HistogramsQA>> jobHistQAs;
+    std::vector<Instrumentation> jobInstrumentations(nJobs, instrumentation);
+    for (int iJob = 0; iJob < nJobs; iJob++) {
+        jobHistQAs.emplace_back(new HistogramsQA());
+        jobHistQAs.back()->addHistograms(histQA);
+        if (jobs[iJob].fMixingStrategy == mixing::MixingStrategy::kSameEvent) {
+            jobHistQAs.back()->hInvMassBeforeEMLikeSign.reset();
+            jobHistQAs.back()->hInvMassBeforeEMUnlikeSign.reset();
+        }
+    }
+
+    std::vector<TFile *> outputFiles;
+    std::vector<TTree *> outputTrees;
+    std::vector<std::unique_ptr<Mixer>> mixers;
+    for (int iJob = 0; iJob < nJobs; iJob++) {
+        const MixingJob& job = jobs[iJob];
+        mixers.emplace_back(new Mixer(hadCandidates, he3Candidates, collisionCandidates, collisionBrackets, hadronsCold, he3sCold,
+                                      job.fMixingDepth, is23));
+        mixers.back()->setSeed(job.fRandomSeed + shard.getSeedOffset());
+        mixers.back()->setAsyncOutput(asyncPipeline, pipelineBatchSize, pipelineDepth);
+        mixers.back()->setFirstHe3(nPoolHe3s);
+        mixers.back()->setHadronProcessTimes(hadronProcessTimes);
+        mixers.back()->setBinMerging(binMerging);
+        mixers.back()->setPairCharge(pairCharge);
+        mixers.back()->setKstarMax(kstarMax, kstarPruning);
+
+        // a resumed job continues the output tree of its last checkpoint, the others start a new output
+        const std::string outputFileName = shardOutputFileName(job.fOutputFileName, shard);
+        TFile * outputFile = nullptr;
+        TTree * outputTree = nullptr;
+        if (resume) {
+            outputFile = TFile::Open(outputFileName.c_str(), "UPDATE");
+            outputTree = outputFile && !outputFile->IsZombie() ? outputFile->Get<TTree>("MixedTree") : nullptr;
+            if (!outputTree || !checkpoint::load(outputFile, outputTree, *mixers.back(), *jobHistQAs[iJob],
+                                                 he3Candidates.size(), hadCandidates.size())) {
+                std::cout << "No checkpoint in " << outputFileName << ", the job starts from the beginning." << std::endl;
+                if (outputFile) {
+                    outputFile->Close();
+                }
+                outputTree = nullptr;
+            }
+        }
+        if (!outputTree) {
+            outputFile = TFile::Open(outputFileName.c_str(), "RECREATE");
+            outputTree = new TTree("MixedTree", "MixedTree");
+        }
+        memoryBudget::applyBasketBytes(outputTree, basketBytes);
+        outputFiles.push_back(outputFile);
+        outputTrees.push_back(outputTree);
+
+        if (checkpointInterval > 0) {
+            // the tree is saved only at the checkpoints, so that the saved entries match the checkpointed state
+            outputTree->SetAutoSave(0);
+            mixers.back()->setCheckpoint(checkpointInterval, [&, iJob](const size_t nextHe3) {
+                ScopedTimer checkpointTimer(jobInstrumentations[iJob], instrumentation::kOutput);
+                checkpoint::save(outputFiles[iJob], outputTrees[iJob], *mixers[iJob], nextHe3, he3Candidates.size(),
+                                 *jobHistQAs[iJob]);
+            });
+        }
+    }
+
+    auto runJob = [&](const int iJob) {
+        if (jobs[iJob].fMixingStrategy == mixing::MixingStrategy::kEvent) {
+            mixers[iJob]->performEventMixing(outputTrees[iJob], *jobHistQAs[iJob], jobInstrumentations[iJob]);
+        } else if (jobs[iJob].fMixingStrategy == mixing::MixingStrategy::kSameEvent) {
+            mixers[iJob]->performSameEvent(outputTrees[iJob], *jobHistQAs[iJob], jobInstrumentations[iJob]);
+        } else {
+            mixers[iJob]->performAngleMixing(outputTrees[iJob], *jobHistQAs[iJob], jobInstrumentations[iJob]);
+        }
+    };
 
     timer.Start();
-    Mixer mixer(hadCandidates, he3Candidates, collisionCandidates, collisionBrackets, mixingDepth, is23);
-    if (mixingStrategy == mixing::MixingStrategy::kEvent) {
-        mixer.performEventMixing(outputTree, histQA);
-    } else if (mixingStrategy == mixing::MixingStrategy::kRotation) {
-        mixer.performAngleMixing(outputTree, histQA);
+    if (parallelJobs) {
+        std::vector<std::thread> jobThreads;
+        for (int iJob = 0; iJob < nJobs; iJob++) {
+            jobThreads.emplace_back(runJob, iJob);
+        }
+        for (auto& jobThread : jobThreads) {
+            jobThread.join();
+        }
     } else {
-        std::cout << "Unknown mixing strategy." << std::endl;
-        return;
+        for (int iJob = 0; iJob < nJobs; iJob++) {
+            runJob(iJob);
+        }
     }
     timer.Stop();
     std::cout << "Event mixing completed in " << timer.RealTime() << " seconds." << std::endl;
 
-    outputFile->cd();
-    outputTree->Write();
+    MemoryReport memoryReport;
+    memoryReport.setBudget(memoryBudgetBytes);
+    memoryReport.set("candidates", memoryAccounting::vectorBytes(hadCandidates) + memoryAccounting::vectorBytes(he3Candidates) +
+                                   memoryAccounting::vectorBytes(collisionCandidates));
+    memoryReport.set("cold fields", hadronsCold.getMemoryBytes() + he3sCold.getMemoryBytes());
+    memoryReport.set("collision brackets", memoryAccounting::vectorBytes(collisionBrackets));
+    size_t mixerBytes = 0;
+    for (const auto& mixer : mixers) {
+        mixerBytes += mixer->getMemoryBytes();
+    }
+    memoryReport.set("mixers", mixerBytes);
+    memoryReport.set("output baskets (limit)", nJobs * basketBytes);
+    memoryReport.printSummary();
+
+    for (int iJob = 0; iJob < nJobs; iJob++) {
+        TFile * outputFile = outputFiles[iJob];
+        {
+            ScopedTimer outputTimer(jobInstrumentations[iJob], instrumentation::kOutput);
+            outputFile->cd();
+            outputTrees[iJob]->Write("", TObject::kOverwrite);
+            if (checkpointInterval > 0 || resume) {
+                checkpoint::remove(outputFile);
+            }
 
-    auto qaDirectory = outputFile->mkdir("HistogramsQA");
-    histQA.saveHistograms(qaDirectory);
-    outputFile->Close();
-    
+            auto qaDirectory = outputFile->mkdir("HistogramsQA");
+            jobHistQAs[iJob]->saveHistograms(qaDirectory);
+        }
+
+        if (binMerging.isMerged()) {
+            binMerging.save(outputFile->mkdir("BinMerging"));
+        }
+
+        if (shard.isSharded()) {
+            outputFile->cd();
+            TNamed shardInfo("BinShard", shard.getLabel().c_str());
+            shardInfo.Write();
+        }
+
+        if (nJobs > 1) {
+            std::cout << "Mixing job " << jobs[iJob].fName << std::endl;
+        }
+        jobInstrumentations[iJob].printSummary();
+        auto instrumentationDirectory = outputFile->mkdir("Instrumentation");
+        jobInstrumentations[iJob].saveSummary(instrumentationDirectory);
+        memoryReport.saveSummary(outputFile->mkdir("Memory"));
+        outputFile->Close();
+    }
+
+    if (!poolFileName.empty()) {
+        TFile * poolFile = TFile::Open(poolFileName.c_str(), "RECREATE");
+        const auto poolJob = std::find_if(jobs.begin(), jobs.end(), isMixingJob);
+        const size_t iPoolJob = poolJob == jobs.end() ? 0 : poolJob - jobs.begin();
+        mixingPool::savePool(poolFile, hadCandidates, he3Candidates, collisionCandidates, hadronsCold, he3sCold,
+                             mixers[iPoolJob]->getHadronProcessTimes());
+        poolFile->Close();
+        std::cout << "Mixing pool saved to " << poolFileName << std::endl;
+    }
+    if (coldStorage == ColdStorage::kDisk && inputCandsFile) {
+        inputCandsFile->Close();
+    }
+    return true;
+}
+
+#ifdef EVENTMIXING_STANDALONE
+int main(int argc, char ** argv)
+{
+    gROOT->SetBatch(true);
+    // usage: mixingLi4 [config] [shardIndex shardCount]
+    bool success;
+    if (argc > 3)
+        success = mixingLi4(argv[1], std::atoi(argv[2]), std::atoi(argv[3]));
+    else if (argc > 1)
+        success = mixingLi4(argv[1]);
+    else
+        success = mixingLi4();
+    return success ? 0 : 1;
 }
+#endif